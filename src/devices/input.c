@@ -1,16 +1,32 @@
 #include "devices/input.h"
 #include <debug.h>
+#include <stdio.h>
+#include <string.h>
 #include "devices/intq.h"
 #include "devices/serial.h"
+#include "threads/synch.h"
 
 /* Stores keys from the keyboard and serial port. */
 static struct intq buffer;
 
+/* Size of the cooked-mode line buffer. */
+#define LINE_MAX 256
+
+/* Cooked-mode input.  LINE holds LINE_READY bytes of completed
+   lines, waiting to be read, followed by the line being edited,
+   up to LINE_LEN.  LINE_EOF is set when Ctrl+D is typed on an
+   empty line, until a read returns 0 for it. */
+static struct lock line_lock;
+static uint8_t line[LINE_MAX];
+static size_t line_ready, line_len;
+static bool line_eof;
+
 /* Initializes the input buffer. */
 void
 input_init (void)
 {
   intq_init (&buffer);
+  lock_init (&line_lock);
 }
 
 /* Adds a key to the input buffer.
@@ -41,6 +57,129 @@ input_getc (void)
   return key;
 }
 
+/* Reads into BUF up to SIZE keys from the input buffer.  If the
+   buffer is empty, waits for a key to be pressed; then takes
+   every key already queued, up to SIZE, without waiting again.
+   Returns the number of keys read, which is 0 only if SIZE is
+   0. */
+size_t
+input_read (uint8_t *buf, size_t size)
+{
+  enum intr_level old_level;
+  size_t cnt;
+
+  old_level = intr_disable ();
+  for (cnt = 0; cnt < size && (cnt == 0 || !intq_empty (&buffer)); cnt++)
+    buf[cnt] = intq_getc (&buffer);
+  serial_notify ();
+  intr_set_level (old_level);
+
+  return cnt;
+}
+
+/* Applies key C to the line being edited, appending what should
+   be echoed to ECHO at *ECHO_CNT.  The line buffer must not be
+   full. */
+static void
+line_cook (uint8_t c, char *echo, size_t *echo_cnt)
+{
+  ASSERT (line_len < LINE_MAX);
+
+  switch (c)
+    {
+    case '\r':
+    case '\n':
+      line[line_len++] = '\n';
+      line_ready = line_len;
+      echo[(*echo_cnt)++] = '\n';
+      break;
+
+    case ('D' - 'A') + 1:       /* Ctrl+D. */
+      if (line_len == line_ready)
+        line_eof = true;
+      line_ready = line_len;
+      break;
+
+    case ('U' - 'A') + 1:       /* Ctrl+U. */
+    case '\b':
+    case 0x7f:
+      while (line_len > line_ready)
+        {
+          /* Back up cursor, overwrite character, back up
+             again. */
+          line_len--;
+          memcpy (echo + *echo_cnt, "\b \b", 3);
+          *echo_cnt += 3;
+          if (c != ('U' - 'A') + 1)
+            break;
+        }
+      break;
+
+    default:
+      line[line_len++] = c;
+      echo[(*echo_cnt)++] = c;
+      break;
+    }
+
+  /* A line that fills the buffer is passed on as is. */
+  if (line_len == LINE_MAX)
+    line_ready = line_len;
+}
+
+/* Reads up to SIZE bytes of cooked input into BUF, which may be
+   in user memory.  Keys are echoed as they are typed, backspace
+   and Ctrl+U edit the current line, carriage returns become
+   new-lines, and nothing is returned until a whole line is
+   complete.  Returns the number of bytes read, which does not
+   extend past the end of a line, or 0 at end of input (Ctrl+D
+   on an empty line). */
+size_t
+input_read_line (void *buf, size_t size)
+{
+  size_t cnt;
+
+  if (size == 0)
+    return 0;
+
+  lock_acquire (&line_lock);
+  while (line_ready == 0 && !line_eof)
+    {
+      /* Each key echoes at most 3 characters and adds at most 1
+         byte to the line, so take no more keys than there is
+         room for; the rest stay queued. */
+      uint8_t keys[64];
+      char echo[3 * sizeof keys];
+      size_t key_cnt, echo_cnt = 0, i;
+      size_t room = LINE_MAX - line_len;
+
+      key_cnt = input_read (keys, room < sizeof keys ? room : sizeof keys);
+      for (i = 0; i < key_cnt; i++)
+        line_cook (keys[i], echo, &echo_cnt);
+      putbuf (echo, echo_cnt);
+    }
+
+  if (line_ready == 0)
+    {
+      line_eof = false;
+      cnt = 0;
+    }
+  else
+    {
+      /* Stop after the first new-line. */
+      uint8_t *nl = memchr (line, '\n', line_ready);
+      cnt = nl != NULL ? (size_t) (nl - line) + 1 : line_ready;
+      if (cnt > size)
+        cnt = size;
+      memcpy (buf, line, cnt);
+      memmove (line, line + cnt, line_len - cnt);
+      line_ready -= cnt;
+      line_len -= cnt;
+    }
+  lock_release (&line_lock);
+
+  return cnt;
+}
+
 /* Returns true if the input buffer is full,
    false otherwise.
    Interrupts must be off. */
@@ -17,8 +17,10 @@
    protect kernel threads from one another, not from interrupt
    handlers. */
 
-/* Queue buffer size, in bytes. */
-#define INTQ_BUFSIZE 64
+/* Queue buffer size, in bytes.  Large enough that the serial
+   transmit queue rarely fills while a process is writing to the
+   console. */
+#define INTQ_BUFSIZE 1024
 
 /* A circular queue of bytes. */
 struct intq
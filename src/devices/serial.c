@@ -33,6 +33,18 @@
 #define MCR_REG (IO_BASE + 4)   /* MODEM Control Register. */
 #define LSR_REG (IO_BASE + 5)   /* Line Status Register (read-only). */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable FIFOs. */
+#define FCR_CLEAR_RX 0x02       /* Clear receive FIFO. */
+#define FCR_CLEAR_TX 0x04       /* Clear transmit FIFO. */
+#define FCR_TRIGGER_1 0x00      /* Receive interrupt after 1 byte. */
+
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* FIFOs enabled (both bits set). */
+
+/* Size of the 16550A transmit FIFO, in bytes. */
+#define TX_FIFO_SIZE 16
+
 /* Interrupt Enable Register bits. */
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
@@ -54,8 +66,13 @@ static enum { UNINIT, POLL, QUEUE } mode;
 /* Data to be transmitted. */
 static struct intq txq;
 
+/* Bytes the UART accepts at once when THR is empty: TX_FIFO_SIZE
+   if it has a working FIFO, otherwise 1. */
+static int tx_burst;
+
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
+static void fill_fifo (void);
 static void write_ier (void);
 static intr_handler_func serial_interrupt;
 
@@ -68,7 +85,10 @@ init_poll (void)
 {
   ASSERT (mode == UNINIT);
   outb (IER_REG, 0);                    /* Turn off all interrupts. */
-  outb (FCR_REG, 0);                    /* Disable FIFO. */
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR_RX | FCR_CLEAR_TX
+                 | FCR_TRIGGER_1);      /* Enable and clear FIFOs. */
+  tx_burst = ((inb (IIR_REG) & IIR_FIFO) == IIR_FIFO
+              ? TX_FIFO_SIZE : 1);      /* 8250 and 16450 have none. */
   set_serial (115200);                  /* 115.2 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
   intq_init (&txq);
@@ -129,6 +149,44 @@ serial_putc (uint8_t byte)
   intr_set_level (old_level);
 }
 
+/* Sends the CNT bytes in BUF to the serial port.  Equivalent to
+   calling serial_putc() on each byte, but interrupts are disabled
+   once for the whole buffer and the interrupt enable register is
+   only rewritten when the transmit queue fills or at the end. */
+void
+serial_write (const uint8_t *buf, size_t cnt)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (mode != QUEUE)
+    {
+      if (mode == UNINIT)
+        init_poll ();
+      while (cnt-- > 0)
+        putc_poll (*buf++);
+    }
+  else
+    {
+      while (cnt-- > 0)
+        {
+          if (intq_full (&txq))
+            {
+              /* As in serial_putc(), poll a byte out if we cannot
+                 sleep.  Otherwise make sure the transmitter is
+                 running before intq_putc() sleeps. */
+              if (old_level == INTR_OFF)
+                putc_poll (intq_getc (&txq));
+              else
+                write_ier ();
+            }
+          intq_putc (&txq, *buf++);
+        }
+      write_ier ();
+    }
+
+  intr_set_level (old_level);
+}
+
 /* Flushes anything in the serial buffer out the port in polling
    mode. */
 void
@@ -136,7 +194,10 @@ serial_flush (void)
 {
   enum intr_level old_level = intr_disable ();
   while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+    {
+      putc_poll (intq_getc (&txq));
+      fill_fifo ();
+    }
   intr_set_level (old_level);
 }
 
@@ -205,6 +266,21 @@ putc_poll (uint8_t byte)
   outb (THR_REG, byte);
 }
 
+/* Moves bytes from the transmit queue into the UART's transmit
+   FIFO, which must have just been found empty or had a single
+   byte written to it, without polling the line status between
+   bytes. */
+static void
+fill_fifo (void)
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = 1; i < tx_burst && !intq_empty (&txq); i++)
+    outb (THR_REG, intq_getc (&txq));
+}
+
 /* Serial interrupt handler. */
 static void
 serial_interrupt (struct intr_frame *f UNUSED)
@@ -218,10 +294,13 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
+  /* As long as we have bytes to transmit, and the hardware is
+     ready to accept them, fill its transmit FIFO. */
   while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0)
-    outb (THR_REG, intq_getc (&txq));
+    {
+      outb (THR_REG, intq_getc (&txq));
+      fill_fifo ();
+    }
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
@@ -25,6 +25,7 @@ static size_t cx, cy;
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+static void put_char (int c);
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
@@ -55,7 +56,34 @@ vga_putc (int c)
   enum intr_level old_level = intr_disable ();
 
   init ();
+  put_char (c);
+  move_cursor ();
+
+  intr_set_level (old_level);
+}
+
+/* Writes the CNT characters in BUF to the VGA text display, as
+   vga_putc() does for each, but moves the hardware cursor only
+   once at the end. */
+void
+vga_write (const char *buf, size_t cnt)
+{
+  enum intr_level old_level = intr_disable ();
+
+  init ();
+  while (cnt-- > 0)
+    put_char ((uint8_t) *buf++);
+  move_cursor ();
 
+  intr_set_level (old_level);
+}
+
+/* Writes C to the framebuffer, interpreting control characters,
+   without updating the hardware cursor.  Interrupts must be
+   off. */
+static void
+put_char (int c)
+{
   switch (c)
     {
     case '\n':
@@ -88,11 +116,6 @@ vga_putc (int c)
         newline ();
       break;
     }
-
-  /* Update cursor position. */
-  move_cursor ();
-
-  intr_set_level (old_level);
 }
 
 /* Clears the screen and moves the cursor to the upper left. */
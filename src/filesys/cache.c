@@ -8,11 +8,14 @@
 #include "devices/disk.h"
 #include "devices/timer.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 
 #define CACHE_SIZE 64
+#define CACHE_CHECKPOINT (CACHE_SIZE / 2)
 #define CACHE_WRITE_BEHIND_INTERVAL 50
 
 struct read_ahead_entry
@@ -21,21 +24,36 @@ struct read_ahead_entry
     struct list_elem elem;              /* List element. */
   };
 
+static void cache_store (disk_sector_t sec_no, const void *buffer,
+                         int sector_ofs, int size, bool meta);
 static struct cache *cache_insert (disk_sector_t sec_no);
 static struct cache *cache_find (disk_sector_t sec_no);
 static void cache_flush (struct cache *cache);
+static void cache_flush_dirty (void);
 static void cache_flush_all (void);
-static void cache_evict (void);
+static void cache_commit (void);
+static struct cache *cache_victim (void);
+static struct cache *cache_evict (void);
 static void cache_write_behind (void *aux UNUSED);
 static void cache_read_ahead (void *aux UNUSED);
 
 static struct list cache_list;
 static struct list cache_free_list;
 static struct lock cache_lock;
+static size_t cache_cnt;                /* Entries in both lists. */
 static struct list read_ahead_list;
 static struct lock read_ahead_lock;
 static struct condition read_ahead_cond;
 
+/* Group commit for cache_sync().  Callers take a ticket; a caller
+   that finds no sync running performs one that covers every
+   ticket handed out so far, while later callers wait for it. */
+static struct lock sync_lock;
+static struct condition sync_cond;
+static unsigned sync_requested;         /* Last ticket handed out. */
+static unsigned sync_completed;         /* Last ticket synced. */
+static bool sync_running;               /* A sync is in progress. */
+
 /* Initializes the buffer cache. */
 void
 cache_init (void)
@@ -52,10 +70,13 @@ cache_init (void)
       lock_init (&cache->lock);
       list_push_front (&cache_free_list, &cache->elem);
     }
+  cache_cnt = CACHE_SIZE;
   lock_init (&cache_lock);
   list_init (&read_ahead_list);
   lock_init (&read_ahead_lock);
   cond_init (&read_ahead_cond);
+  lock_init (&sync_lock);
+  cond_init (&sync_cond);
 
   tid = thread_create ("cache_write_behind", PRI_DEFAULT,
                        cache_write_behind, NULL);
@@ -92,6 +113,85 @@ cache_read (disk_sector_t sec_no, void *buffer, int sector_ofs, int size)
    cache. */
 void
 cache_write (disk_sector_t sec_no, const void *buffer, int sector_ofs, int size)
+{
+  cache_store (sec_no, buffer, sector_ofs, size, false);
+}
+
+/* Like cache_write(), but for sectors holding file system
+   metadata (inodes, indirect blocks, directories and the free
+   map), which reach their home on disk only through the
+   journal. */
+void
+cache_write_meta (disk_sector_t sec_no, const void *buffer, int sector_ofs,
+                  int size)
+{
+  cache_store (sec_no, buffer, sector_ofs, size, true);
+}
+
+/* Makes all file data and metadata written so far durable.
+   Concurrent callers are batched into a single journal commit,
+   which runs with FILESYS_LOCK held so that it contains only
+   whole file system operations.  The caller must not hold
+   FILESYS_LOCK. */
+void
+cache_sync (void)
+{
+  unsigned ticket, batch;
+
+  lock_acquire (&sync_lock);
+  ticket = ++sync_requested;
+  while ((int) (ticket - sync_completed) > 0)
+    {
+      if (sync_running)
+        cond_wait (&sync_cond, &sync_lock);
+      else
+        {
+          sync_running = true;
+          batch = sync_requested;
+          lock_release (&sync_lock);
+
+          filesys_acquire ();
+          cache_flush_all ();
+          filesys_release ();
+
+          lock_acquire (&sync_lock);
+          sync_running = false;
+          sync_completed = batch;
+          cond_broadcast (&sync_cond, &sync_lock);
+        }
+    }
+  lock_release (&sync_lock);
+}
+
+/* Commits the modified metadata once CACHE_CHECKPOINT sectors of
+   it have piled up, so that a transaction never outgrows the
+   journal.  Must be called between file system operations, with
+   FILESYS_LOCK held. */
+void
+cache_checkpoint (void)
+{
+  struct list_elem *e;
+  struct cache *cache;
+  size_t cnt = 0;
+
+  lock_acquire (&cache_lock);
+  for (e = list_begin (&cache_list); e != list_end (&cache_list);
+       e = list_next (e))
+    {
+      cache = list_entry (e, struct cache, elem);
+      if (cache->loaded && cache->dirty && cache->meta)
+        cnt++;
+    }
+  if (cnt >= CACHE_CHECKPOINT)
+    cache_flush_dirty ();
+  lock_release (&cache_lock);
+}
+
+/* Write SIZE bytes from BUFFER into SEC_NO sector using buffer
+   cache, marking the sector as metadata if META is true. */
+static void
+cache_store (disk_sector_t sec_no, const void *buffer, int sector_ofs,
+             int size, bool meta)
 {
   struct cache *cache;
 
@@ -108,6 +208,7 @@ cache_write (disk_sector_t sec_no, const void *buffer, int sector_ofs, int size)
     lock_acquire (&cache->lock);
   cache->loaded = true;
   cache->dirty = true;
+  cache->meta = meta;
   memcpy (cache->buffer + sector_ofs, (const uint8_t *) buffer, size);
   lock_release (&cache->lock);
   lock_release (&cache_lock);
@@ -117,55 +218,140 @@ cache_write (disk_sector_t sec_no, const void *buffer, int sector_ofs, int size)
 void
 cache_request (disk_sector_t sec_no)
 {
-  struct read_ahead_entry *rae;
+  cache_request_multiple (&sec_no, 1);
+}
 
-  if (sec_no >= disk_size (filesys_disk))
-    return;
+/* Request a read-ahead of the CNT sectors in SECTORS into buffer
+   cache, queueing them together with a single wakeup of the
+   read-ahead thread.  Sectors already cached are skipped. */
+void
+cache_request_multiple (const disk_sector_t *sectors, size_t cnt)
+{
+  struct read_ahead_entry *rae;
+  struct list batch;
+  size_t i;
 
+  list_init (&batch);
   lock_acquire (&cache_lock);
-  if (cache_find (sec_no) != NULL)
+  for (i = 0; i < cnt; i++)
     {
-      lock_release (&cache_lock);
-      return;
+      if (sectors[i] >= disk_size (filesys_disk)
+          || cache_find (sectors[i]) != NULL)
+        continue;
+      rae = (struct read_ahead_entry *)
+        malloc (sizeof (struct read_ahead_entry));
+      if (rae == NULL)
+        break;
+      rae->sec_no = sectors[i];
+      list_push_back (&batch, &rae->elem);
     }
   lock_release (&cache_lock);
 
-  rae = (struct read_ahead_entry *) malloc (sizeof (struct read_ahead_entry));
-  rae->sec_no = sec_no;
+  if (list_empty (&batch))
+    return;
+
   lock_acquire (&read_ahead_lock);
-  list_push_back (&read_ahead_list, &rae->elem);
+  while (!list_empty (&batch))
+    list_push_back (&read_ahead_list, list_pop_front (&batch));
   cond_signal (&read_ahead_cond, &read_ahead_lock);
   lock_release (&read_ahead_lock);
 }
 
-/* Flush modified CACHE into disk. */
+/* Flush modified file data in CACHE into disk.  Modified metadata
+   reaches disk only through cache_commit().  CACHE_LOCK must be
+   held. */
 static void
 cache_flush (struct cache *cache)
 {
   lock_acquire (&cache->lock);
   if (cache->loaded && cache->dirty)
     {
+      ASSERT (!cache->meta);
       disk_write (filesys_disk, cache->sec_no, cache->buffer);
       cache->dirty = false;
     }
   lock_release (&cache->lock);
 }
 
+/* Flush all modified cache into disk: file data first, so that
+   committed metadata never points to unwritten data, and then the
+   metadata through the journal.  CACHE_LOCK must be held. */
+static void
+cache_flush_dirty (void)
+{
+  struct list_elem *e;
+  struct cache *cache;
+
+  for (e = list_begin (&cache_list); e != list_end (&cache_list);
+       e = list_next (e))
+    {
+      cache = list_entry (e, struct cache, elem);
+      if (!cache->meta)
+        cache_flush (cache);
+    }
+  cache_commit ();
+}
+
 /* Flush all modified cache into disk. */
 static void
 cache_flush_all (void)
 {
+  lock_acquire (&cache_lock);
+  cache_flush_dirty ();
+  lock_release (&cache_lock);
+}
+
+/* Writes every modified metadata sector home as one transaction:
+   the sectors are first logged sequentially and committed in the
+   journal, and only then written in place, so that a crash
+   leaves either all or none of the transaction's updates.
+   Callers commit only between file system operations, and
+   cache_checkpoint() keeps the transaction within the journal.
+   CACHE_LOCK must be held. */
+static void
+cache_commit (void)
+{
+  static disk_sector_t *targets;
+  static void **buffers;
+  static struct cache **batch;
+  size_t capacity = journal_capacity ();
   struct list_elem *e;
   struct cache *cache;
+  size_t cnt, i;
 
-  lock_acquire (&cache_lock);
+  if (targets == NULL)
+    {
+      targets = malloc (capacity * sizeof *targets);
+      buffers = malloc (capacity * sizeof *buffers);
+      batch = malloc (capacity * sizeof *batch);
+      if (targets == NULL || buffers == NULL || batch == NULL)
+        PANIC ("can't allocate journal transaction");
+    }
+
+  cnt = 0;
   for (e = list_begin (&cache_list); e != list_end (&cache_list);
        e = list_next (e))
     {
       cache = list_entry (e, struct cache, elem);
-      cache_flush (cache);
+      if (cache->loaded && cache->dirty && cache->meta)
+        {
+          if (cnt == capacity)
+            PANIC ("metadata transaction exceeds the journal");
+          targets[cnt] = cache->sec_no;
+          buffers[cnt] = cache->buffer;
+          batch[cnt++] = cache;
+        }
     }
-  lock_release (&cache_lock);
+  if (cnt == 0)
+    return;
+
+  journal_write (targets, buffers, cnt);
+  for (i = 0; i < cnt; i++)
+    {
+      disk_write (filesys_disk, targets[i], buffers[i]);
+      batch[i]->dirty = false;
+    }
+  journal_clear ();
 }
 
 /* Destroy buffer cache. */
@@ -175,10 +361,10 @@ cache_clear (void)
   struct cache *cache;
 
   lock_acquire (&cache_lock);
+  cache_flush_dirty ();
   while (!list_empty (&cache_list))
     {
       cache = list_entry (list_pop_back (&cache_list), struct cache, elem);
-      cache_flush (cache);
       free (cache);
     }
   while (!list_empty (&cache_free_list))
@@ -196,11 +382,13 @@ cache_insert (disk_sector_t sec_no)
   struct cache *cache;
 
   if (list_empty (&cache_free_list))
-    cache_evict ();
-  cache = list_entry (list_pop_back (&cache_free_list), struct cache, elem);
+    cache = cache_evict ();
+  else
+    cache = list_entry (list_pop_back (&cache_free_list), struct cache, elem);
   cache->sec_no = sec_no;
   cache->loaded = false;
   cache->dirty = false;
+  cache->meta = false;
   list_push_front (&cache_list, &cache->elem);
   return cache;
 }
@@ -228,15 +416,50 @@ cache_find (disk_sector_t sec_no)
   return NULL;
 }
 
-/* Flush the oldest cache and remove it. */
-static void
+/* Returns the oldest cache that does not hold modified metadata,
+   or a null pointer if there is none.  CACHE_LOCK must be held. */
+static struct cache *
+cache_victim (void)
+{
+  struct list_elem *e;
+  struct cache *cache;
+
+  for (e = list_rbegin (&cache_list); e != list_rend (&cache_list);
+       e = list_prev (e))
+    {
+      cache = list_entry (e, struct cache, elem);
+      if (!(cache->loaded && cache->dirty && cache->meta))
+        return cache;
+    }
+  return NULL;
+}
+
+/* Flush the oldest cache that does not hold modified metadata,
+   remove it, and return it for reuse.  Modified metadata stays
+   cached until the next commit between file system operations,
+   so if nothing else is left the cache grows past CACHE_SIZE for
+   a while, and shrinks back on later evictions. */
+static struct cache *
 cache_evict (void)
 {
   struct cache *cache;
 
-  cache = list_entry (list_pop_back (&cache_list), struct cache, elem);
-  cache_flush (cache);
-  list_push_front (&cache_free_list, &cache->elem);
+  while ((cache = cache_victim ()) != NULL)
+    {
+      list_remove (&cache->elem);
+      cache_flush (cache);
+      if (cache_cnt <= CACHE_SIZE)
+        return cache;
+      free (cache);
+      cache_cnt--;
+    }
+
+  cache = (struct cache *) malloc (sizeof (struct cache));
+  if (cache == NULL)
+    PANIC ("can't grow buffer cache");
+  lock_init (&cache->lock);
+  cache_cnt++;
+  return cache;
 }
 
 /* Write-behind thread for buffer cache. */
@@ -246,7 +469,13 @@ cache_write_behind (void *aux UNUSED)
   while (true)
     {
       timer_sleep (CACHE_WRITE_BEHIND_INTERVAL);
-      cache_flush_all ();
+
+      /* Choose sectors for delayed blocks so they can be written. */
+      filesys_acquire ();
+      inode_flush_all ();
+      filesys_release ();
+
+      cache_sync ();
     }
 }
 
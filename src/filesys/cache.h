@@ -2,6 +2,7 @@
 #define FILESYS_CACHE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <list.h>
 #include "devices/disk.h"
@@ -14,6 +15,7 @@ struct cache
     disk_sector_t sec_no;               /* Sector number of disk. */
     bool loaded;                        /* Cache is loaded. */
     bool dirty;                         /* Dirty bit. */
+    bool meta;                          /* Holds file system metadata. */
     struct lock lock;                   /* Lock for writing. */
     struct list_elem elem;              /* List element. */
   };
@@ -21,7 +23,12 @@ struct cache
 void cache_init (void);
 void cache_read (disk_sector_t, void *buffer, int sector_ofs, int size);
 void cache_write (disk_sector_t, const void *buffer, int sector_ofs, int size);
+void cache_write_meta (disk_sector_t, const void *buffer, int sector_ofs,
+                       int size);
+void cache_sync (void);
+void cache_checkpoint (void);
 void cache_request (disk_sector_t sec_no);
+void cache_request_multiple (const disk_sector_t *sectors, size_t cnt);
 void cache_clear (void);
 
 #endif /* filesys/cache.h */
@@ -6,6 +6,11 @@
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/thread.h"
+#include "filesys/cache.h"
+
+/* Number of directory entries whose inodes are prefetched at
+   once while reading a directory. */
+#define DIR_PREFETCH_CNT 16
 
 /* A single directory entry. */
 struct dir_entry
@@ -213,20 +218,61 @@ dir_remove (struct dir *dir, const char *name)
   return success;
 }
 
+/* Queues the inode sectors of the DIR_PREFETCH_CNT entries
+   starting at DIR's current position for read-ahead, so that a
+   caller stat'ing each name returned by dir_readdir() finds the
+   inodes already cached. */
+static void
+dir_prefetch (struct dir *dir)
+{
+  struct dir_entry *entries;
+  disk_sector_t sectors[DIR_PREFETCH_CNT];
+  size_t entry_cnt, sector_cnt, i;
+
+  entries = malloc (DIR_PREFETCH_CNT * sizeof *entries);
+  if (entries == NULL)
+    return;
+
+  entry_cnt = inode_read_at (dir->inode, entries,
+                             DIR_PREFETCH_CNT * sizeof *entries, dir->pos)
+              / sizeof *entries;
+  sector_cnt = 0;
+  for (i = 0; i < entry_cnt; i++)
+    if (entries[i].in_use)
+      sectors[sector_cnt++] = entries[i].inode_sector;
+  free (entries);
+
+  cache_request_multiple (sectors, sector_cnt);
+}
+
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
    contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
+{
+  disk_sector_t sector;
+
+  return dir_readdir_sector (dir, name, &sector);
+}
+
+/* Like dir_readdir(), but also stores the entry's inode sector
+   into *SECTORP. */
+bool
+dir_readdir_sector (struct dir *dir, char name[NAME_MAX + 1],
+                    disk_sector_t *sectorp)
 {
   struct dir_entry e;
 
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e)
     {
+      if (dir->pos % (DIR_PREFETCH_CNT * sizeof e) == 0)
+        dir_prefetch (dir);
       dir->pos += sizeof e;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
+          *sectorp = e.inode_sector;
           return true;
         }
     }
@@ -322,11 +368,12 @@ dir_path_and_name (const char *dir, char **path, char **name)
 bool
 dir_empty (const struct dir *dir)
 {
-  char name[NAME_MAX + 1];
-  struct dir dir_copy;
-
-  dir_copy.inode = dir->inode;
-  dir_copy.pos = 0;
+  struct dir_entry e;
+  off_t ofs;
 
-  return !dir_readdir (&dir_copy, name);
+  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (e.in_use)
+      return false;
+  return true;
 }
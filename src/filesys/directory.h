@@ -32,6 +32,8 @@ bool dir_lookup (const struct dir *, const char *name, struct inode **);
 bool dir_add (struct dir *, const char *name, disk_sector_t);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+bool dir_readdir_sector (struct dir *, char name[NAME_MAX + 1],
+                         disk_sector_t *);
 
 /* Utilities. */
 struct dir *dir_parse (const char *dir);
@@ -84,6 +84,15 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
   return inode_read_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Starts reading SIZE bytes of FILE, starting at offset START,
+   into the buffer cache in the background.
+   The file's current position is unaffected. */
+void
+file_prefetch (struct file *file, off_t size, off_t start)
+{
+  inode_prefetch (file->inode, size, start);
+}
+
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written.
@@ -7,13 +7,22 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
 #include "devices/disk.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 
 /* The disk that contains the file system. */
 struct disk *filesys_disk;
 
+/* Sectors per data block.  Chosen with -fb when formatting;
+   otherwise taken from the root directory when mounting. */
+size_t filesys_block_sectors = FILESYS_BLOCK_SECTORS;
+
+/* Serializes file system operations. */
+static struct lock filesys_lock;
+
 static void do_format (void);
 
 /* Initializes the file system module.
@@ -21,6 +30,8 @@ static void do_format (void);
 void
 filesys_init (bool format)
 {
+  lock_init (&filesys_lock);
+
   filesys_disk = disk_get (0, 1);
   if (filesys_disk == NULL)
     PANIC ("hd0:1 (hdb) not present, file system initialization failed");
@@ -32,6 +43,16 @@ filesys_init (bool format)
 
   if (format)
     do_format ();
+  else
+    {
+      journal_recover ();
+      filesys_block_sectors
+        = inode_block_sectors (dir_get_inode (thread_current ()->dir));
+      if (filesys_block_sectors < 1
+          || filesys_block_sectors > FILESYS_BLOCK_SECTORS_MAX)
+        PANIC ("root directory has %zu-sector data blocks",
+               filesys_block_sectors);
+    }
 
   free_map_open ();
 }
@@ -41,6 +62,8 @@ filesys_init (bool format)
 void
 filesys_done (void)
 {
+  inode_reclaim_all ();
+  inode_flush_all ();
   free_map_close ();
   cache_clear ();
 }
@@ -198,9 +221,27 @@ static void
 do_format (void)
 {
   printf ("Formatting file system...");
+  journal_create ();
   free_map_create ();
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
 }
+
+/* Acquires the file system lock, which serializes file system
+   operations.  No operation is in progress at that point, so it
+   is also where piled-up metadata gets committed. */
+void
+filesys_acquire (void)
+{
+  lock_acquire (&filesys_lock);
+  cache_checkpoint ();
+}
+
+/* Releases the file system lock. */
+void
+filesys_release (void)
+{
+  lock_release (&filesys_lock);
+}
@@ -2,19 +2,33 @@
 #define FILESYS_FILESYS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* Journal header sector. */
+
+/* Sectors per file data block.  With larger blocks every file
+   too big to be inline takes at least a whole block, which the
+   small disks the tests format cannot spare, so the default is
+   one sector and -fb selects up to one 4 kB page. */
+#define FILESYS_BLOCK_SECTORS 1
+#define FILESYS_BLOCK_SECTORS_MAX 8
 
 /* Disk used for file system. */
 extern struct disk *filesys_disk;
 
+/* Sectors per data block of files created from now on. */
+extern size_t filesys_block_sectors;
+
 void filesys_init (bool format);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size, bool is_dir);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
+void filesys_acquire (void);
+void filesys_release (void);
 
 #endif /* filesys/filesys.h */
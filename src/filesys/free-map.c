@@ -4,9 +4,39 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static size_t free_cnt;              /* Number of free sectors. */
+static size_t reserved_cnt;          /* Free sectors set aside by
+                                        free_map_reserve(). */
+
+/* Free space in a range of the free map.  These summaries form a
+   segment tree over the free map, kept in memory only, so that
+   the first run of free sectors of any length is found in time
+   logarithmic in the disk size instead of by scanning the bitmap
+   bit by bit. */
+struct run_summary
+  {
+    size_t len;                      /* Number of sectors covered. */
+    size_t head;                     /* Free sectors at the start. */
+    size_t tail;                     /* Free sectors at the end. */
+    size_t longest;                  /* Longest run of free sectors. */
+  };
+
+/* Sectors covered by a leaf of the summary tree. */
+#define SUMMARY_LEAF_BITS 32
+
+/* Summary tree.  Node 1 is the root, the children of node I are
+   nodes 2I and 2I + 1, and leaves start at node LEAF_CNT. */
+static struct run_summary *summary;
+static size_t leaf_cnt;              /* Number of leaves, a power of 2. */
+
+static void summary_build (void);
+static void summary_update (size_t start, size_t cnt);
+static size_t summary_find (size_t cnt);
 
 /* Initializes the free map. */
 void
@@ -15,39 +45,103 @@ free_map_init (void)
   free_map = bitmap_create (disk_size (filesys_disk));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--disk is too large");
+  for (leaf_cnt = 1; leaf_cnt * SUMMARY_LEAF_BITS < bitmap_size (free_map);
+       leaf_cnt *= 2)
+    continue;
+  summary = malloc (2 * leaf_cnt * sizeof *summary);
+  if (summary == NULL)
+    PANIC ("free space summary creation failed--disk is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, journal_sectors (), true);
+  free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
+  reserved_cnt = 0;
+  summary_build ();
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  Sectors set aside by
+   free_map_reserve() are not handed out.
    Returns true if successful, false if all sectors were
    available. */
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp)
 {
-  disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  disk_sector_t sector = BITMAP_ERROR;
+
+  if (cnt <= free_cnt - reserved_cnt)
+    sector = summary_find (cnt);
+  if (sector != BITMAP_ERROR)
+    {
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      summary_update (sector, cnt);
+    }
   if (sector != BITMAP_ERROR
       && free_map_file != NULL
       && !bitmap_write (free_map, free_map_file))
     {
       bitmap_set_multiple (free_map, sector, cnt, false);
+      summary_update (sector, cnt);
       sector = BITMAP_ERROR;
     }
   if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+    {
+      *sectorp = sector;
+      free_cnt -= cnt;
+    }
   return sector != BITMAP_ERROR;
 }
 
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (disk_sector_t sector, size_t cnt)
+{
+  free_map_unmark (sector, cnt);
+  free_map_flush ();
+}
+
+/* Makes CNT sectors starting at SECTOR available for use without
+   writing the free map to disk.  A caller releasing many runs
+   calls free_map_flush() once after the last of them. */
+void
+free_map_unmark (disk_sector_t sector, size_t cnt)
 {
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
+  summary_update (sector, cnt);
+  free_cnt += cnt;
+}
+
+/* Writes the free map to disk. */
+void
+free_map_flush (void)
+{
   bitmap_write (free_map, free_map_file);
 }
 
+/* Sets aside CNT free sectors, without choosing which ones, so
+   that a later free_map_allocate() of them cannot fail for lack
+   of space.  The caller must give them back with
+   free_map_unreserve() before allocating them.
+   Returns true if successful, false if not enough sectors are
+   free. */
+bool
+free_map_reserve (size_t cnt)
+{
+  if (cnt > free_cnt - reserved_cnt)
+    return false;
+  reserved_cnt += cnt;
+  return true;
+}
+
+/* Returns CNT sectors set aside by free_map_reserve(). */
+void
+free_map_unreserve (size_t cnt)
+{
+  ASSERT (cnt <= reserved_cnt);
+  reserved_cnt -= cnt;
+}
+
 /* Opens the free map file and reads it from disk. */
 void
 free_map_open (void)
@@ -57,6 +151,8 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
+  summary_build ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
@@ -71,14 +167,134 @@ free_map_close (void)
 void
 free_map_create (void)
 {
+  struct file *file;
+
   /* Create inode. */
   if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  /* Write bitmap to file.  The file starts out as one big hole,
+     so the first write only reserves its data sectors and
+     inode_flush() allocates them; that happens before
+     FREE_MAP_FILE is set, so free_map_allocate() does not recurse
+     into writing the free map.  The second write then records
+     those allocations. */
+  file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC ("can't open free map");
+  if (!bitmap_write (free_map, file))
+    PANIC ("can't write free map");
+  inode_flush (file_get_inode (file));
+  free_map_file = file;
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
+
+/* Recomputes the summary of leaf node NODE from the free map. */
+static void
+summary_leaf (size_t node)
+{
+  struct run_summary *s = &summary[node];
+  size_t start = (node - leaf_cnt) * SUMMARY_LEAF_BITS;
+  size_t end = start + SUMMARY_LEAF_BITS;
+  size_t run = 0;
+  size_t i;
+
+  if (start > bitmap_size (free_map))
+    start = bitmap_size (free_map);
+  if (end > bitmap_size (free_map))
+    end = bitmap_size (free_map);
+
+  s->len = end - start;
+  s->head = s->longest = 0;
+  for (i = start; i < end; i++)
+    {
+      run = bitmap_test (free_map, i) ? 0 : run + 1;
+      if (run == i - start + 1)
+        s->head = run;
+      if (run > s->longest)
+        s->longest = run;
+    }
+  s->tail = run;
+}
+
+/* Recomputes the summary of inner node NODE from its
+   children. */
+static void
+summary_merge (size_t node)
+{
+  struct run_summary *s = &summary[node];
+  const struct run_summary *l = &summary[2 * node];
+  const struct run_summary *r = &summary[2 * node + 1];
+
+  s->len = l->len + r->len;
+  s->head = l->head == l->len ? l->len + r->head : l->head;
+  s->tail = r->tail == r->len ? r->len + l->tail : r->tail;
+  s->longest = l->tail + r->head;
+  if (l->longest > s->longest)
+    s->longest = l->longest;
+  if (r->longest > s->longest)
+    s->longest = r->longest;
+}
+
+/* Rebuilds the whole summary tree from the free map. */
+static void
+summary_build (void)
+{
+  size_t node;
+
+  for (node = leaf_cnt; node < 2 * leaf_cnt; node++)
+    summary_leaf (node);
+  for (node = leaf_cnt - 1; node >= 1; node--)
+    summary_merge (node);
+}
+
+/* Updates the summary tree after CNT sectors starting at START
+   changed in the free map. */
+static void
+summary_update (size_t start, size_t cnt)
+{
+  size_t lo, hi, node;
+
+  if (cnt == 0)
+    return;
+
+  lo = leaf_cnt + start / SUMMARY_LEAF_BITS;
+  hi = leaf_cnt + (start + cnt - 1) / SUMMARY_LEAF_BITS;
+  for (node = lo; node <= hi; node++)
+    summary_leaf (node);
+  for (lo /= 2, hi /= 2; lo >= 1; lo /= 2, hi /= 2)
+    for (node = lo; node <= hi; node++)
+      summary_merge (node);
+}
+
+/* Returns the first sector of the lowest run of CNT free sectors,
+   or BITMAP_ERROR if there is none. */
+static size_t
+summary_find (size_t cnt)
+{
+  const struct run_summary *l, *r;
+  size_t node = 1;
+  size_t start = 0;
+
+  if (summary[1].longest < cnt)
+    return BITMAP_ERROR;
+
+  while (node < leaf_cnt)
+    {
+      l = &summary[2 * node];
+      r = &summary[2 * node + 1];
+      if (l->longest >= cnt)
+        node = 2 * node;
+      else if (l->tail + r->head >= cnt)
+        return start + l->len - l->tail;
+      else
+        {
+          start += l->len;
+          node = 2 * node + 1;
+        }
+    }
+
+  /* The run lies within this leaf. */
+  return bitmap_scan (free_map, start, cnt, false);
+}
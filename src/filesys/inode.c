@@ -18,22 +18,39 @@
 #define INODE_INDIRECT_BLOCKS 128
 #define INODE_DOUBLE_INDIRECT_BLOCKS 128 * 128
 #define INODE_OFFSET_LENGTH 0
+#define INODE_OFFSET_SECTOR_COUNT 4
 #define INODE_OFFSET_IS_DIR 8
+#define INODE_OFFSET_IS_INLINE 9
+#define INODE_OFFSET_BLOCK_SECTORS 10
 #define INODE_OFFSET_PARENT 12
+#define INODE_OFFSET_INLINE 76
+
+/* Largest file whose data fits inside its inode sector. */
+#define INODE_INLINE_SIZE 436
+
+/* Number of sectors' worth of delayed blocks an inode may buffer
+   before inode_write_at() flushes them itself. */
+#define INODE_DELAYED_MAX 64
+
+/* Removed files with more data sectors than this are cleared by
+   the reclaim thread rather than by their last inode_close(). */
+#define INODE_RECLAIM_MIN 256
 
 /* On-disk inode.
    Must be exactly DISK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
     off_t length;                       /* File size in bytes. */
-    size_t sector_count;                /* Number of used disk sectors. */
+    size_t sector_count;                /* Number of allocated data sectors. */
     bool is_dir;                        /* This is directory or not. */
+    bool is_inline;                     /* Data is kept in inline_data. */
+    uint8_t block_sectors;              /* Sectors per data block. */
     disk_sector_t parent;               /* Sector number of parent directory. */
     disk_sector_t directs[INODE_DIRECT_BLOCKS];     /* Direct blocks. */
     disk_sector_t indirect;             /* Single indirect block. */
     disk_sector_t double_indirect;      /* Double indirect block. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[109];               /* Not used. */
+    uint8_t inline_data[INODE_INLINE_SIZE]; /* Data of a small file. */
   };
 
 /* Indirect block.
@@ -43,203 +60,316 @@ struct indirect_block
     disk_sector_t blocks[INODE_INDIRECT_BLOCKS];    /* Blocks. */
   };
 
-/* Returns the number of sectors to allocate for an inode SIZE
-   bytes long. */
-static inline size_t
-bytes_to_sectors (off_t size)
+/* A block of data written into a hole for which no disk sectors
+   have been chosen yet.  Its sectors, and any indirect blocks
+   needed to point to them, are reserved in the free map at write
+   time; inode_flush() allocates the actual sectors, so that runs
+   of such blocks end up contiguous on disk. */
+struct delayed_block
+  {
+    size_t idx;                         /* Data block index. */
+    size_t reserved;                    /* Sectors reserved for it. */
+    struct list_elem elem;              /* Element in delayed_list. */
+    uint8_t data[];                     /* Block contents. */
+  };
+
+/* Run of consecutive sectors collected by inode_clear(), so that
+   they go back to the free map with a single bitmap update. */
+struct release_run
+  {
+    disk_sector_t start;                /* First sector of the run. */
+    size_t cnt;                         /* Number of sectors. */
+  };
+
+/* A removed inode waiting to be cleared by the reclaim thread. */
+struct reclaim_entry
+  {
+    disk_sector_t sector;               /* Inode sector. */
+    struct list_elem elem;              /* Element in reclaim_list. */
+  };
+
+/* Allocates a zero-filled sector and stores it into *SECTORP.
+   Returns true if successful, false if the disk is full. */
+static bool
+sector_allocate (disk_sector_t *sectorp)
 {
-  return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
+  static char zeros[DISK_SECTOR_SIZE];
+
+  if (!free_map_allocate (1, sectorp))
+    return false;
+  cache_write_meta (*sectorp, zeros, 0, DISK_SECTOR_SIZE);
+  return true;
 }
 
-/* Returns the disk sector that contains byte offset POS within
-   INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+/* Returns the sector stored in entry IDX of the indirect block at
+   sector BLOCK.  If the entry is empty and ALLOCATE is true,
+   allocates a zero-filled sector for it first.
+   Returns 0 if the entry is a hole or allocation fails. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos)
+indirect_lookup (disk_sector_t block, size_t idx, bool allocate)
 {
-  disk_sector_t sec_no = -1;
-  disk_sector_t indirect_sector;
-  struct inode_disk *disk;
-  off_t offset;
-  off_t indirect_offset;
-  off_t double_indirect_offset;
-  off_t entry_count;
-
-  ASSERT (inode != NULL);
+  disk_sector_t sector;
 
-  if (pos >= inode_length (inode))
-    return -1;
+  cache_read (block, &sector, idx * sizeof sector, sizeof sector);
+  if (sector == 0 && allocate)
+    {
+      if (!sector_allocate (&sector))
+        return 0;
+      cache_write_meta (block, &sector, idx * sizeof sector, sizeof sector);
+    }
+  return sector;
+}
 
-  offset = pos / DISK_SECTOR_SIZE;
-  disk = (struct inode_disk *) malloc (sizeof *disk);
-  ASSERT (disk != NULL);
-  cache_read (inode->sector, disk, 0, sizeof (struct inode_disk));
+/* Finds the block map entry for data block IDX of the inode
+   whose on-disk copy is DISK.  On success, stores into *BLOCKP
+   the sector of the indirect block that holds the entry, or 0 if
+   the entry is one of DISK's direct blocks, and stores the
+   entry's index into *ENTRYP.
 
-  /* Read from direct block. */
-  if (offset < INODE_DIRECT_BLOCKS)
-    sec_no = disk->directs[offset];
-  /* Read from indirect block. */
-  else if (offset < INODE_DIRECT_BLOCKS + INODE_INDIRECT_BLOCKS)
+   If ALLOCATE is true, missing indirect blocks on the way are
+   allocated and DISK is updated in place; the caller must write
+   DISK back.  Returns false if IDX is out of range, or if an
+   indirect block is missing and cannot be allocated. */
+static bool
+index_to_entry (struct inode_disk *disk, size_t idx, bool allocate,
+                disk_sector_t *blockp, size_t *entryp)
+{
+  /* Direct block. */
+  if (idx < INODE_DIRECT_BLOCKS)
     {
-      indirect_offset = offset - INODE_DIRECT_BLOCKS;
-      cache_read (disk->indirect, (void *) &sec_no,
-                  indirect_offset * sizeof (disk_sector_t),
-                  sizeof (disk_sector_t));
+      *blockp = 0;
+      *entryp = idx;
+      return true;
     }
-  /* Read from double indirect block. */
-  else if (offset < (INODE_DIRECT_BLOCKS + INODE_INDIRECT_BLOCKS
-                     + INODE_DOUBLE_INDIRECT_BLOCKS))
-    {
-      entry_count = offset - (INODE_DIRECT_BLOCKS + INODE_INDIRECT_BLOCKS);
-      double_indirect_offset = entry_count / INODE_INDIRECT_BLOCKS;
-      indirect_offset = entry_count % INODE_INDIRECT_BLOCKS;
-
-      cache_read (disk->double_indirect, (void *) &indirect_sector,
-                  double_indirect_offset * sizeof (disk_sector_t),
-                  sizeof (disk_sector_t));
+  idx -= INODE_DIRECT_BLOCKS;
 
-      cache_read (indirect_sector, (void *) &sec_no,
-                  indirect_offset * sizeof (disk_sector_t),
-                  sizeof (disk_sector_t));
+  /* Indirect block. */
+  if (idx < INODE_INDIRECT_BLOCKS)
+    {
+      if (disk->indirect == 0
+          && (!allocate || !sector_allocate (&disk->indirect)))
+        return false;
+      *blockp = disk->indirect;
+      *entryp = idx;
+      return true;
     }
-  free (disk);
+  idx -= INODE_INDIRECT_BLOCKS;
 
-  return sec_no;
+  /* Double indirect block. */
+  if (idx < INODE_DOUBLE_INDIRECT_BLOCKS)
+    {
+      if (disk->double_indirect == 0
+          && (!allocate || !sector_allocate (&disk->double_indirect)))
+        return false;
+      *blockp = indirect_lookup (disk->double_indirect,
+                                 idx / INODE_INDIRECT_BLOCKS, allocate);
+      *entryp = idx % INODE_INDIRECT_BLOCKS;
+      return *blockp != 0;
+    }
+  return false;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Returns the number of indirect block sectors that installing
+   data block IDX in the inode whose on-disk copy is DISK may have
+   to allocate. */
+static size_t
+index_meta_sectors (struct inode_disk *disk, size_t idx)
+{
+  if (idx < INODE_DIRECT_BLOCKS)
+    return 0;
+  idx -= INODE_DIRECT_BLOCKS;
+  if (idx < INODE_INDIRECT_BLOCKS)
+    return disk->indirect == 0 ? 1 : 0;
+  idx -= INODE_INDIRECT_BLOCKS;
+  if (disk->double_indirect == 0)
+    return 2;
+  return indirect_lookup (disk->double_indirect,
+                          idx / INODE_INDIRECT_BLOCKS, false) == 0 ? 1 : 0;
+}
 
-/* Initializes the inode module. */
-void
-inode_init (void)
+/* Returns the disk sector that holds data block IDX of the inode
+   whose on-disk copy is DISK, or 0 if the block is a hole. */
+static disk_sector_t
+index_to_sector (struct inode_disk *disk, size_t idx)
 {
-  list_init (&open_inodes);
+  disk_sector_t block;
+  size_t entry;
+
+  if (!index_to_entry (disk, idx, false, &block, &entry))
+    return 0;
+  if (block == 0)
+    return disk->directs[entry];
+  return indirect_lookup (block, entry, false);
 }
 
-/* Adds a sector SECTOR to INODE. */
+/* Points data block IDX of the inode whose on-disk copy is DISK
+   at the block starting at SECTOR, allocating indirect blocks as
+   needed.  DISK is
+   updated in place and must be written back by the caller.
+   Returns false if an indirect block cannot be allocated. */
 static bool
-inode_append (struct inode *inode, disk_sector_t sector)
+index_install (struct inode_disk *disk, size_t idx, disk_sector_t sector)
+{
+  disk_sector_t block;
+  size_t entry;
+
+  if (!index_to_entry (disk, idx, true, &block, &entry))
+    return false;
+  if (block == 0)
+    disk->directs[entry] = sector;
+  else
+    cache_write_meta (block, &sector, entry * sizeof sector, sizeof sector);
+  disk->sector_count += disk->block_sectors;
+  return true;
+}
+
+/* Returns the disk sector that contains byte offset POS within
+   INODE.
+   Returns 0 if no disk sector has been allocated for offset POS,
+   either because POS lies in a hole or because the data written
+   there is still a delayed block. */
+static disk_sector_t
+byte_to_sector (const struct inode *inode, off_t pos)
 {
   struct inode_disk *disk;
-  off_t offset;
-  off_t indirect_offset;
-  off_t double_indirect_offset;
-  off_t entry_count;
-  disk_sector_t indirect_sector;
+  disk_sector_t sec_no;
 
-  disk = (struct inode_disk *) malloc (sizeof *disk);
+  ASSERT (inode != NULL);
+  ASSERT (pos >= 0);
 
+  disk = (struct inode_disk *) malloc (sizeof *disk);
   ASSERT (disk != NULL);
-
   cache_read (inode->sector, disk, 0, sizeof (struct inode_disk));
+  ASSERT (disk->block_sectors > 0);
+  sec_no = index_to_sector (disk, pos / (disk->block_sectors
+                                        * DISK_SECTOR_SIZE));
+  if (sec_no != 0)
+    sec_no += pos % (disk->block_sectors * DISK_SECTOR_SIZE)
+              / DISK_SECTOR_SIZE;
+  free (disk);
 
-  /* Direct block. */
-  if (disk->sector_count < INODE_DIRECT_BLOCKS)
-    disk->directs[disk->sector_count] = sector;
-  /* Indirect block. */
-  else if (disk->sector_count < INODE_DIRECT_BLOCKS + INODE_INDIRECT_BLOCKS)
-    {
-      offset = disk->sector_count - INODE_DIRECT_BLOCKS;
-
-      /* Create an indirect block. */
-      if (offset == 0)
-        {
-          static char zeros[DISK_SECTOR_SIZE];
-
-          if (!free_map_allocate (1, &disk->indirect))
-            return false;
-          cache_write (disk->indirect, zeros, 0, DISK_SECTOR_SIZE);
-        }
+  return sec_no;
+}
 
-      cache_write (disk->indirect, (void *) &sector,
-                   offset * sizeof (disk_sector_t), sizeof (disk_sector_t));
-    }
-  /* Double indirect block. */
-  else if (disk->sector_count < (INODE_DIRECT_BLOCKS + INODE_INDIRECT_BLOCKS
-                                 + INODE_DOUBLE_INDIRECT_BLOCKS))
-    {
-      entry_count = disk->sector_count - (INODE_DIRECT_BLOCKS
-                                          + INODE_INDIRECT_BLOCKS);
-      double_indirect_offset = entry_count / INODE_INDIRECT_BLOCKS;
-      indirect_offset = entry_count % INODE_INDIRECT_BLOCKS;
+/* Returns the element of INODE's delayed list for the first
+   delayed block whose index is IDX or greater, or the list's end.
+   INODE's lock must be held. */
+static struct list_elem *
+delayed_locate (struct inode *inode, size_t idx)
+{
+  struct list_elem *e;
 
-      /* Create a double indirect block. */
-      if (entry_count == 0)
-        {
-          static char zeros[DISK_SECTOR_SIZE];
+  for (e = list_begin (&inode->delayed_list);
+       e != list_end (&inode->delayed_list); e = list_next (e))
+    if (list_entry (e, struct delayed_block, elem)->idx >= idx)
+      break;
+  return e;
+}
 
-          if (!free_map_allocate (1, &disk->double_indirect))
-            return false;
-          cache_write (disk->double_indirect, zeros, 0, DISK_SECTOR_SIZE);
-        }
+/* Returns INODE's delayed block for data block IDX, or a null
+   pointer if there is none.  INODE's lock must be held. */
+static struct delayed_block *
+delayed_find (struct inode *inode, size_t idx)
+{
+  struct list_elem *e = delayed_locate (inode, idx);
+  struct delayed_block *db;
 
-      /* Create an indirect block. */
-      if (indirect_offset == 0)
-        {
-          static char zeros[DISK_SECTOR_SIZE];
+  if (e == list_end (&inode->delayed_list))
+    return NULL;
+  db = list_entry (e, struct delayed_block, elem);
+  return db->idx == idx ? db : NULL;
+}
 
-          if (!free_map_allocate (1, &indirect_sector))
-            return false;
-          cache_write (indirect_sector, zeros, 0, DISK_SECTOR_SIZE);
+/* Returns INODE's delayed block for data block IDX, creating a
+   zero-filled one if there is none.  A new block reserves its
+   data sectors and, in the worst case, the indirect blocks that
+   installing it may need, so that inode_flush() cannot run out
+   of space for it.  The delayed list is kept sorted by block
+   index.  Returns a null pointer if IDX is beyond the largest
+   possible file, the disk is full, or memory allocation fails.
+   INODE's lock must be held. */
+static struct delayed_block *
+delayed_get (struct inode *inode, size_t idx)
+{
+  struct inode_disk *disk;
+  struct list_elem *e;
+  struct delayed_block *db;
+  size_t block_sectors, reserved;
 
-          cache_write (disk->double_indirect, (void *) &indirect_sector,
-                       double_indirect_offset * sizeof (disk_sector_t),
-                       sizeof (disk_sector_t));
-        }
+  if (idx >= (INODE_DIRECT_BLOCKS + INODE_INDIRECT_BLOCKS
+              + INODE_DOUBLE_INDIRECT_BLOCKS))
+    return NULL;
 
-      cache_read (disk->double_indirect, (void *) &indirect_sector,
-                  double_indirect_offset * sizeof (disk_sector_t),
-                  sizeof (disk_sector_t));
+  e = delayed_locate (inode, idx);
+  if (e != list_end (&inode->delayed_list)
+      && list_entry (e, struct delayed_block, elem)->idx == idx)
+    return list_entry (e, struct delayed_block, elem);
 
-      cache_write (indirect_sector, (void *) &sector,
-                   indirect_offset * sizeof (disk_sector_t),
-                   sizeof (disk_sector_t));
-    }
-  disk->sector_count++;
-  cache_write (inode->sector, (void *) disk, 0, DISK_SECTOR_SIZE);
+  disk = (struct inode_disk *) malloc (sizeof *disk);
+  if (disk == NULL)
+    return NULL;
+  cache_read (inode->sector, disk, 0, DISK_SECTOR_SIZE);
+  block_sectors = disk->block_sectors;
+  reserved = block_sectors + index_meta_sectors (disk, idx);
   free (disk);
 
-  return true;
+  if (!free_map_reserve (reserved))
+    return NULL;
+  db = (struct delayed_block *) calloc (1, sizeof *db
+                                        + block_sectors * DISK_SECTOR_SIZE);
+  if (db == NULL)
+    {
+      free_map_unreserve (reserved);
+      return NULL;
+    }
+  db->idx = idx;
+  db->reserved = reserved;
+  list_insert (e, &db->elem);
+  inode->delayed_cnt++;
+  return db;
 }
 
-/* Extends the INODE with LENGTH bytes. */
-static bool
-inode_extend (struct inode *inode, off_t length)
+/* Throws away INODE's delayed blocks and gives back the space
+   reserved for them.  INODE's lock must be held. */
+static void
+delayed_discard (struct inode *inode)
 {
-  struct inode_disk *disk;
-  off_t free_length;
-  size_t sectors;
-  disk_sector_t sector;
-  size_t i;
+  struct delayed_block *db;
 
-  lock_acquire (&inode->lock);
-  disk = (struct inode_disk *) malloc (sizeof *disk);
+  while (!list_empty (&inode->delayed_list))
+    {
+      db = list_entry (list_pop_front (&inode->delayed_list),
+                       struct delayed_block, elem);
+      free_map_unreserve (db->reserved);
+      free (db);
+    }
+  inode->delayed_cnt = 0;
+}
 
-  ASSERT (disk != NULL);
+/* List of open inodes, so that opening a single inode twice
+   returns the same `struct inode'. */
+static struct list open_inodes;
 
-  cache_read (inode->sector, disk, 0, DISK_SECTOR_SIZE);
+/* Removed inodes waiting for the reclaim thread. */
+static struct list reclaim_list;
+static struct lock reclaim_lock;
+static struct condition reclaim_cond;
 
-  free_length = disk->sector_count * DISK_SECTOR_SIZE - disk->length;
-  sectors = bytes_to_sectors (length - free_length);
+static void inode_reclaim (void *aux UNUSED);
 
-  for (i = 0; i < sectors; i++)
-    {
-      if (!free_map_allocate (1, &sector)
-          || !inode_append (inode, sector))
-        {
-          lock_release (&inode->lock);
-          return false;
-        }
-    }
-  disk->length += length;
-  cache_write (inode->sector, &disk->length, INODE_OFFSET_LENGTH, 4);
-  lock_release (&inode->lock);
+/* Initializes the inode module. */
+void
+inode_init (void)
+{
+  tid_t tid;
 
-  free (disk);
-  return true;
+  list_init (&open_inodes);
+  list_init (&reclaim_list);
+  lock_init (&reclaim_lock);
+  cond_init (&reclaim_cond);
+
+  tid = thread_create ("inode_reclaim", PRI_DEFAULT, inode_reclaim, NULL);
+  ASSERT (tid != TID_ERROR);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -251,7 +381,6 @@ bool
 inode_create (disk_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
-  struct inode *inode;
   bool success = false;
 
   ASSERT (length >= 0);
@@ -260,19 +389,25 @@ inode_create (disk_sector_t sector, off_t length, bool is_dir)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == DISK_SECTOR_SIZE);
 
+  /* A small inode keeps its data inline.  A larger one has its
+     data blocks allocated lazily when written, so it starts out
+     all holes.  Either way it reads back as zeros. */
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      disk_inode->length = 0;
+      disk_inode->length = length;
       disk_inode->sector_count = 0;
       disk_inode->is_dir = is_dir;
+      disk_inode->is_inline = length <= INODE_INLINE_SIZE;
+      ASSERT (filesys_block_sectors >= 1
+              && filesys_block_sectors <= FILESYS_BLOCK_SECTORS_MAX);
+      disk_inode->block_sectors = filesys_block_sectors;
       disk_inode->parent = dir_get_inode (thread_current ()->dir)->sector;
       disk_inode->magic = INODE_MAGIC;
 
-      cache_write (sector, disk_inode, 0, DISK_SECTOR_SIZE);
-      inode = inode_open (sector);
-      success = inode_extend (inode, length);
+      cache_write_meta (sector, disk_inode, 0, DISK_SECTOR_SIZE);
       free (disk_inode);
+      success = true;
     }
   return success;
 }
@@ -310,6 +445,8 @@ inode_open (disk_sector_t sector)
   inode->deny_write_cnt = 0;
   inode->removed = false;
   lock_init (&inode->lock);
+  list_init (&inode->delayed_list);
+  inode->delayed_cnt = 0;
   return inode;
 }
 
@@ -332,13 +469,83 @@ inode_get_inumber (const struct inode *inode)
 /* Returns whether INODE is directory or not. */
 bool
 inode_is_dir (const struct inode *inode)
+{
+  return inode_sector_is_dir (inode->sector);
+}
+
+/* Returns whether the inode stored in SECTOR is a directory,
+   reading only its cached inode sector, without opening it. */
+bool
+inode_sector_is_dir (disk_sector_t sector)
 {
   bool is_dir;
-  cache_read (inode->sector, &is_dir, INODE_OFFSET_IS_DIR, sizeof (bool));
+  cache_read (sector, &is_dir, INODE_OFFSET_IS_DIR, sizeof (bool));
 
   return is_dir;
 }
 
+/* Returns the number of sectors in each of INODE's data
+   blocks, which is never 0. */
+size_t
+inode_block_sectors (const struct inode *inode)
+{
+  uint8_t block_sectors;
+  cache_read (inode->sector, &block_sectors, INODE_OFFSET_BLOCK_SECTORS,
+              sizeof (uint8_t));
+  ASSERT (block_sectors > 0);
+  return block_sectors;
+}
+
+/* Returns whether INODE's data is file system metadata, i.e. it
+   is a directory or the free map, and so is journaled. */
+static bool
+inode_is_meta (const struct inode *inode)
+{
+  return inode->sector == FREE_MAP_SECTOR || inode_is_dir (inode);
+}
+
+/* Returns whether INODE keeps its data inside its inode sector. */
+static bool
+inode_is_inline (const struct inode *inode)
+{
+  bool is_inline;
+  cache_read (inode->sector, &is_inline, INODE_OFFSET_IS_INLINE,
+              sizeof (bool));
+  return is_inline;
+}
+
+/* Switches INODE from inline data to a block map, so it can grow
+   past INODE_INLINE_SIZE bytes.  The inline data moves into a
+   delayed block for data block 0.  INODE's lock must be held.
+   Returns false if no space can be reserved for that block. */
+static bool
+inode_promote (struct inode *inode)
+{
+  struct inode_disk *disk;
+  struct delayed_block *db;
+
+  disk = (struct inode_disk *) malloc (sizeof *disk);
+  ASSERT (disk != NULL);
+  cache_read (inode->sector, disk, 0, DISK_SECTOR_SIZE);
+
+  if (disk->length > 0)
+    {
+      db = delayed_get (inode, 0);
+      if (db == NULL)
+        {
+          free (disk);
+          return false;
+        }
+      memcpy (db->data, disk->inline_data, disk->length);
+    }
+
+  disk->is_inline = false;
+  memset (disk->inline_data, 0, sizeof disk->inline_data);
+  cache_write_meta (inode->sector, disk, 0, DISK_SECTOR_SIZE);
+  free (disk);
+  return true;
+}
+
 disk_sector_t
 inode_get_parent (const struct inode *inode)
 {
@@ -348,87 +555,156 @@ inode_get_parent (const struct inode *inode)
   return parent;
 }
 
-/* Clear the INODE data. */
+/* Adds the CNT sectors starting at SECTOR to RUN, first handing
+   RUN back to the free map if they do not extend it. */
 static void
-inode_clear (struct inode *inode)
+release_add (struct release_run *run, disk_sector_t sector, size_t cnt)
+{
+  if (run->cnt > 0 && sector == run->start + run->cnt)
+    {
+      run->cnt += cnt;
+      return;
+    }
+  if (run->cnt > 0)
+    free_map_unmark (run->start, run->cnt);
+  run->start = sector;
+  run->cnt = cnt;
+}
+
+/* Adds every allocated data block of BLOCK_SECTORS sectors listed
+   in the indirect block at sector BLOCK, descending LEVEL more
+   levels of indirection, and then BLOCK itself to RUN.  Holes are
+   skipped. */
+static void
+indirect_clear (disk_sector_t block, int level, size_t block_sectors,
+                struct release_run *run)
 {
-  struct inode_disk *disk;
-  struct indirect_block *double_indirect;
   struct indirect_block *indirect;
-  size_t double_entry_count;
-  size_t entry_count;
-  off_t offset;
   size_t i;
 
-  disk = (struct inode_disk *) malloc (sizeof *disk);
-  ASSERT (disk != NULL);
-  cache_read (inode->sector, disk, 0, DISK_SECTOR_SIZE);
+  indirect = (struct indirect_block *) malloc (sizeof *indirect);
+  ASSERT (indirect != NULL);
+  cache_read (block, indirect, 0, DISK_SECTOR_SIZE);
+
+  for (i = 0; i < INODE_INDIRECT_BLOCKS; i++)
+    if (indirect->blocks[i] != 0)
+      {
+        if (level > 0)
+          indirect_clear (indirect->blocks[i], level - 1, block_sectors,
+                          run);
+        else
+          release_add (run, indirect->blocks[i], block_sectors);
+      }
+
+  free (indirect);
+  release_add (run, block, 1);
+}
 
-  ASSERT (disk->sector_count <= (INODE_DIRECT_BLOCKS + INODE_INDIRECT_BLOCKS
-                                 + INODE_DOUBLE_INDIRECT_BLOCKS));
+/* Clears the data of the inode at SECTOR and releases its data
+   sectors together with SECTOR itself, writing the free map
+   once. */
+static void
+inode_clear (disk_sector_t sector)
+{
+  struct inode_disk *disk;
+  struct release_run run;
+  size_t i;
 
-  if (disk->sector_count == 0)
-    return;
+  disk = (struct inode_disk *) malloc (sizeof *disk);
+  ASSERT (disk != NULL);
+  cache_read (sector, disk, 0, DISK_SECTOR_SIZE);
 
-  /* Double indirect block. */
-  if (disk->sector_count > INODE_DIRECT_BLOCKS + INODE_INDIRECT_BLOCKS)
+  run.cnt = 0;
+  if (!disk->is_inline && disk->sector_count > 0)
     {
-      double_entry_count = disk->sector_count - (INODE_DIRECT_BLOCKS
-                                                 + INODE_INDIRECT_BLOCKS);
-
-      double_indirect = ((struct indirect_block *)
-                         malloc (sizeof *double_indirect));
-      ASSERT (double_indirect != NULL);
-      cache_read (disk->double_indirect, double_indirect, 0, DISK_SECTOR_SIZE);
-
-      indirect = (struct indirect_block *) malloc (sizeof *indirect);
-      ASSERT (indirect != NULL);
+      for (i = 0; i < INODE_DIRECT_BLOCKS; i++)
+        if (disk->directs[i] != 0)
+          release_add (&run, disk->directs[i], disk->block_sectors);
+      if (disk->indirect != 0)
+        indirect_clear (disk->indirect, 0, disk->block_sectors, &run);
+      if (disk->double_indirect != 0)
+        indirect_clear (disk->double_indirect, 1, disk->block_sectors,
+                        &run);
+    }
 
-      while (double_entry_count > 0)
-        {
-          offset = double_entry_count / INODE_INDIRECT_BLOCKS;
-          cache_read (double_indirect->blocks[offset], indirect, 0,
-                      DISK_SECTOR_SIZE);
+  memset (disk->directs, 0, sizeof disk->directs);
+  memset (disk->inline_data, 0, sizeof disk->inline_data);
+  disk->indirect = 0;
+  disk->double_indirect = 0;
+  disk->is_inline = true;
+  disk->length = 0;
+  disk->sector_count = 0;
+  cache_write_meta (sector, (void *) disk, 0, DISK_SECTOR_SIZE);
+  free (disk);
 
-          if (double_entry_count > INODE_INDIRECT_BLOCKS)
-            entry_count = double_entry_count % INODE_INDIRECT_BLOCKS;
-          else
-            entry_count = double_entry_count;
+  release_add (&run, sector, 1);
+  free_map_unmark (run.start, run.cnt);
+  free_map_flush ();
+}
 
-          for (i = 0; i < entry_count; i++)
-            free_map_release (indirect->blocks[i], 1);
+/* Clears every removed inode still waiting in reclaim_list. */
+void
+inode_reclaim_all (void)
+{
+  struct reclaim_entry *re;
 
-          double_entry_count -= entry_count;
+  for (;;)
+    {
+      lock_acquire (&reclaim_lock);
+      if (list_empty (&reclaim_list))
+        {
+          lock_release (&reclaim_lock);
+          break;
         }
-      free (double_indirect);
-      free (indirect);
-      disk->sector_count = INODE_DIRECT_BLOCKS + INODE_INDIRECT_BLOCKS;
+      re = list_entry (list_pop_front (&reclaim_list),
+                       struct reclaim_entry, elem);
+      lock_release (&reclaim_lock);
+
+      inode_clear (re->sector);
+      free (re);
     }
+}
 
-  /* Indirect block. */
-  if (disk->sector_count > INODE_DIRECT_BLOCKS)
+/* Reclaim thread: clears large removed inodes in the background
+   so that closing them returns right away. */
+static void
+inode_reclaim (void *aux UNUSED)
+{
+  for (;;)
     {
-      entry_count = disk->sector_count - INODE_DIRECT_BLOCKS;
-
-      indirect = (struct indirect_block *) malloc (sizeof *indirect);
-      ASSERT (indirect != NULL);
-      cache_read (disk->indirect, &indirect, 0, DISK_SECTOR_SIZE);
+      lock_acquire (&reclaim_lock);
+      while (list_empty (&reclaim_list))
+        cond_wait (&reclaim_cond, &reclaim_lock);
+      lock_release (&reclaim_lock);
+
+      filesys_acquire ();
+      inode_reclaim_all ();
+      filesys_release ();
+    }
+}
 
-      for (i = 0; i < entry_count; i++)
-        free_map_release (indirect->blocks[i], 1);
+/* Clears the removed INODE, handing it to the reclaim thread if
+   it owns many data sectors. */
+static void
+inode_release (struct inode *inode)
+{
+  struct reclaim_entry *re;
+  size_t sector_count;
 
-      free (indirect);
-      disk->sector_count = INODE_DIRECT_BLOCKS;
+  cache_read (inode->sector, &sector_count, INODE_OFFSET_SECTOR_COUNT,
+              sizeof (size_t));
+  if (sector_count <= INODE_RECLAIM_MIN
+      || (re = malloc (sizeof *re)) == NULL)
+    {
+      inode_clear (inode->sector);
+      return;
     }
 
-  /* Direct block. */
-  for (i = 0; i < disk->sector_count; i++)
-    free_map_release (disk->directs[i], 1);
-
-  disk->length = 0;
-  disk->sector_count = 0;
-  cache_write (inode->sector, (void *) disk, 0, DISK_SECTOR_SIZE);
-  free (disk);
+  re->sector = inode->sector;
+  lock_acquire (&reclaim_lock);
+  list_push_back (&reclaim_list, &re->elem);
+  cond_signal (&reclaim_cond, &reclaim_lock);
+  lock_release (&reclaim_lock);
 }
 
 /* Closes INODE and writes it to disk.
@@ -444,20 +720,27 @@ inode_close (struct inode *inode)
   /* Release resources if this was the last opener. */
   if (--inode->open_cnt == 0)
     {
-      lock_acquire (&inode->lock);
-
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
-
       /* Deallocate blocks if removed. */
       if (inode->removed)
         {
-          inode_clear (inode);
-          free_map_release (inode->sector, 1);
+          lock_acquire (&inode->lock);
+          list_remove (&inode->elem);
+          delayed_discard (inode);
+          inode_release (inode);
+          lock_release (&inode->lock);
+          free (inode);
+          return;
         }
 
-      lock_release (&inode->lock);
-      free (inode);
+      /* Otherwise give delayed blocks their sectors.  If some
+         cannot be placed yet, keep the inode on the open list so
+         that inode_flush_all() retries and frees it later; a
+         reopen picks it up again meanwhile. */
+      if (inode_flush (inode))
+        {
+          list_remove (&inode->elem);
+          free (inode);
+        }
     }
 }
 
@@ -478,11 +761,33 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
+  struct delayed_block *db;
+  disk_sector_t ahead[FILESYS_BLOCK_SECTORS_MAX];
+  size_t block_sectors, block_size, i;
+  off_t length;
+
+  /* Inline data is read straight out of the inode sector. */
+  lock_acquire (&inode->lock);
+  if (inode_is_inline (inode))
+    {
+      length = inode_length (inode);
+      if (offset < length)
+        {
+          bytes_read = size < length - offset ? size : length - offset;
+          cache_read (inode->sector, buffer, INODE_OFFSET_INLINE + offset,
+                      bytes_read);
+        }
+      lock_release (&inode->lock);
+      return bytes_read;
+    }
+  lock_release (&inode->lock);
+  block_sectors = inode_block_sectors (inode);
+  block_size = block_sectors * DISK_SECTOR_SIZE;
 
   while (size > 0)
     {
       /* Disk sector to read, starting byte offset within sector. */
-      disk_sector_t sector_idx = byte_to_sector (inode, offset);
+      disk_sector_t sector_idx;
       int sector_ofs = offset % DISK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -495,9 +800,35 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
+      /* Read a block without a sector from its delayed copy, or
+         as zeros if it is a hole. */
+      lock_acquire (&inode->lock);
+      sector_idx = byte_to_sector (inode, offset);
+      if (sector_idx == 0)
+        {
+          db = delayed_find (inode, offset / block_size);
+          if (db != NULL)
+            memcpy (buffer + bytes_read, db->data + offset % block_size,
+                    chunk_size);
+          else
+            memset (buffer + bytes_read, 0, chunk_size);
+        }
+      lock_release (&inode->lock);
+
       /* Read sector through buffer cache. */
-      cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
-      cache_request (sector_idx + 1);
+      if (sector_idx != 0)
+        {
+          cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+
+          /* On entering a block, read ahead the rest of it and the
+             sector that follows in one batch. */
+          if (offset % block_size < DISK_SECTOR_SIZE)
+            {
+              for (i = 0; i < block_sectors; i++)
+                ahead[i] = sector_idx + 1 + i;
+              cache_request_multiple (ahead, block_sectors);
+            }
+        }
 
       /* Advance. */
       size -= chunk_size;
@@ -508,6 +839,44 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   return bytes_read;
 }
 
+/* Starts reading the SIZE bytes of INODE at OFFSET into the
+   buffer cache in the background, so that a later read of them
+   need not wait for the disk.  Holes, delayed blocks, and bytes
+   past the end of INODE are skipped. */
+void
+inode_prefetch (struct inode *inode, off_t size, off_t offset)
+{
+  disk_sector_t sectors[FILESYS_BLOCK_SECTORS_MAX];
+  disk_sector_t sec_no;
+  size_t cnt = 0;
+  off_t length, pos;
+
+  lock_acquire (&inode->lock);
+  if (!inode_is_inline (inode))
+    {
+      length = inode_length (inode);
+      if (size > length - offset)
+        size = length - offset;
+      for (pos = offset - offset % DISK_SECTOR_SIZE; pos < offset + size;
+           pos += DISK_SECTOR_SIZE)
+        {
+          sec_no = byte_to_sector (inode, pos);
+          if (sec_no == 0)
+            continue;
+          sectors[cnt++] = sec_no;
+          if (cnt == FILESYS_BLOCK_SECTORS_MAX)
+            {
+              cache_request_multiple (sectors, cnt);
+              cnt = 0;
+            }
+        }
+    }
+  lock_release (&inode->lock);
+
+  if (cnt > 0)
+    cache_request_multiple (sectors, cnt);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if an error occurs. */
@@ -517,34 +886,78 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  off_t length;
+  struct delayed_block *db = NULL;
+  size_t block_sectors, block_size;
+  bool meta;
 
   if (inode->deny_write_cnt)
     return 0;
+  meta = inode_is_meta (inode);
+  block_sectors = inode_block_sectors (inode);
+  block_size = block_sectors * DISK_SECTOR_SIZE;
 
-  /* Extend file. */
-  length = inode_length (inode);
-  if (offset + size > length)
-    inode_extend (inode, offset + size - length);
+  /* Write inline data in place while it still fits, otherwise
+     switch to a block map first. */
+  lock_acquire (&inode->lock);
+  if (inode_is_inline (inode))
+    {
+      if (offset + size <= INODE_INLINE_SIZE)
+        {
+          cache_write_meta (inode->sector, buffer,
+                            INODE_OFFSET_INLINE + offset, size);
+          offset += size;
+          if (offset > inode_length (inode))
+            cache_write_meta (inode->sector, &offset, INODE_OFFSET_LENGTH,
+                              sizeof (off_t));
+          lock_release (&inode->lock);
+          return size;
+        }
+      if (!inode_promote (inode))
+        {
+          lock_release (&inode->lock);
+          return 0;
+        }
+    }
+  lock_release (&inode->lock);
 
   while (size > 0)
     {
       /* Sector to write, starting byte offset within sector. */
-      disk_sector_t sector_idx = byte_to_sector (inode, offset);
+      disk_sector_t sector_idx;
       int sector_ofs = offset % DISK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left in sector. */
       int sector_left = DISK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      int chunk_size = size < sector_left ? size : sector_left;
+
+      /* Writing into a hole, including one past end of file,
+         only reserves space: the data goes into a delayed block
+         and its sector is chosen by inode_flush(). */
+      lock_acquire (&inode->lock);
+      sector_idx = byte_to_sector (inode, offset);
+      if (sector_idx == 0)
+        {
+          db = delayed_get (inode, offset / block_size);
+          if (db != NULL)
+            memcpy (db->data + offset % block_size, buffer + bytes_written,
+                    chunk_size);
+        }
+      lock_release (&inode->lock);
+      if (sector_idx == 0 && db == NULL)
         break;
 
       /* Write sector through buffer cache. */
-      cache_write (sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
+      if (sector_idx != 0)
+        {
+          if (meta)
+            cache_write_meta (sector_idx, buffer + bytes_written, sector_ofs,
+                              chunk_size);
+          else
+            cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+                         chunk_size);
+        }
 
       /* Advance. */
       size -= chunk_size;
@@ -552,9 +965,153 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       bytes_written += chunk_size;
     }
 
+  /* Extend file.  The check and update are one step under the
+     inode's lock, so that a shorter concurrent extension cannot
+     overwrite a longer one. */
+  lock_acquire (&inode->lock);
+  if (offset > inode_length (inode))
+    cache_write_meta (inode->sector, &offset, INODE_OFFSET_LENGTH, sizeof (off_t));
+  lock_release (&inode->lock);
+
+  if (inode->delayed_cnt * block_sectors >= INODE_DELAYED_MAX)
+    inode_flush (inode);
+
   return bytes_written;
 }
 
+/* Allocates disk sectors for INODE's delayed blocks and writes
+   them through the buffer cache.  Each run of consecutive blocks
+   is given consecutive sectors in a single free map allocation
+   where free space allows, so a burst of small appends turns
+   into one contiguous extent.
+
+   Returns true if every delayed block was placed.  Blocks that
+   cannot be placed, because free space is too fragmented to hold
+   a whole multi-sector block, stay on the delayed list with their
+   reservation intact for a later attempt. */
+bool
+inode_flush (struct inode *inode)
+{
+  struct inode_disk *disk;
+  struct delayed_block *db;
+  struct list_elem *e;
+  disk_sector_t sector = 0, block;
+  size_t block_sectors, run, reserved, cnt, i, j;
+  bool meta;
+  bool success = true;
+
+  lock_acquire (&inode->lock);
+  if (list_empty (&inode->delayed_list))
+    {
+      lock_release (&inode->lock);
+      return true;
+    }
+  meta = inode_is_meta (inode);
+
+  disk = (struct inode_disk *) malloc (sizeof *disk);
+  ASSERT (disk != NULL);
+  cache_read (inode->sector, disk, 0, DISK_SECTOR_SIZE);
+  block_sectors = disk->block_sectors;
+
+  while (success && !list_empty (&inode->delayed_list))
+    {
+      /* Count the run of consecutive blocks at the front and hand
+         back its reservation, data and indirect blocks alike. */
+      e = list_begin (&inode->delayed_list);
+      db = list_entry (e, struct delayed_block, elem);
+      reserved = db->reserved;
+      for (run = 1, e = list_next (e);
+           e != list_end (&inode->delayed_list)
+           && list_entry (e, struct delayed_block, elem)->idx == db->idx + run;
+           run++, e = list_next (e))
+        reserved += list_entry (e, struct delayed_block, elem)->reserved;
+      free_map_unreserve (reserved);
+
+      while (run > 0)
+        {
+          /* Prefer a single extent; settle for shorter ones when
+             free space is fragmented. */
+          for (cnt = run; cnt > 0; cnt /= 2)
+            if (free_map_allocate (cnt * block_sectors, &sector))
+              break;
+          if (cnt == 0)
+            {
+              success = false;
+              break;
+            }
+
+          for (i = 0; i < cnt; i++)
+            {
+              db = list_entry (list_front (&inode->delayed_list),
+                               struct delayed_block, elem);
+              block = sector + i * block_sectors;
+              if (!index_install (disk, db->idx, block))
+                {
+                  free_map_release (block, (cnt - i) * block_sectors);
+                  success = false;
+                  break;
+                }
+              for (j = 0; j < block_sectors; j++)
+                if (meta)
+                  cache_write_meta (block + j,
+                                    db->data + j * DISK_SECTOR_SIZE, 0,
+                                    DISK_SECTOR_SIZE);
+                else
+                  cache_write (block + j, db->data + j * DISK_SECTOR_SIZE,
+                               0, DISK_SECTOR_SIZE);
+              list_pop_front (&inode->delayed_list);
+              inode->delayed_cnt--;
+              free (db);
+            }
+          run -= i;
+          if (!success)
+            break;
+        }
+
+      /* Take back the reservation of the blocks left over.  Every
+         block placed used no more than it had reserved, so this
+         cannot fail. */
+      if (!success)
+        {
+          for (reserved = 0, e = list_begin (&inode->delayed_list);
+               run > 0; run--, e = list_next (e))
+            reserved += list_entry (e, struct delayed_block, elem)->reserved;
+          if (!free_map_reserve (reserved))
+            NOT_REACHED ();
+        }
+    }
+
+  cache_write_meta (inode->sector, disk, 0, DISK_SECTOR_SIZE);
+  free (disk);
+  lock_release (&inode->lock);
+  return success;
+}
+
+/* Flushes the delayed blocks of every open inode.  Called
+   periodically by the buffer cache's write-behind thread.
+   Also frees closed inodes that inode_close() left behind because
+   their delayed blocks could not be placed.  Each inode's flush
+   is an operation of its own for the journal.  FILESYS_LOCK must
+   be held. */
+void
+inode_flush_all (void)
+{
+  struct list_elem *e, *next;
+  struct inode *inode;
+
+  for (e = list_begin (&open_inodes); e != list_end (&open_inodes); e = next)
+    {
+      inode = list_entry (e, struct inode, elem);
+      next = list_next (e);
+      if (inode_flush (inode) && inode->open_cnt == 0)
+        {
+          list_remove (&inode->elem);
+          free (inode);
+        }
+      cache_checkpoint ();
+    }
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -16,6 +16,8 @@ struct inode
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct lock lock;                   /* Lock for writing data. */
+    struct list delayed_list;           /* Blocks awaiting allocation. */
+    size_t delayed_cnt;                 /* Number of delayed blocks. */
   };
 
 struct bitmap;
@@ -26,13 +28,19 @@ struct inode *inode_open (disk_sector_t);
 struct inode *inode_reopen (struct inode *);
 disk_sector_t inode_get_inumber (const struct inode *);
 bool inode_is_dir (const struct inode *);
+bool inode_sector_is_dir (disk_sector_t);
+size_t inode_block_sectors (const struct inode *);
 disk_sector_t inode_get_parent (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+void inode_prefetch (struct inode *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+bool inode_flush (struct inode *);
+void inode_flush_all (void);
+void inode_reclaim_all (void);
 
 #endif /* filesys/inode.h */
@@ -0,0 +1,171 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+
+/* Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Home sectors recorded in each descriptor sector. */
+#define JOURNAL_TARGETS (DISK_SECTOR_SIZE / sizeof (disk_sector_t))
+
+/* On-disk journal header, stored at JOURNAL_SECTOR.
+   The header is followed by descriptor sectors, which record the
+   home of each logged sector, and then by the logged sectors
+   themselves.  A transaction is committed once a header with a
+   nonzero CNT reaches the disk; the header is a single sector,
+   so that write is atomic.
+   Must be exactly DISK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    unsigned magic;                     /* Magic number. */
+    uint32_t cnt;                       /* Number of logged sectors. */
+    uint8_t unused[DISK_SECTOR_SIZE - 8];
+  };
+
+/* Returns the number of descriptor sectors. */
+static size_t
+desc_cnt (void)
+{
+  return DIV_ROUND_UP (journal_capacity (), JOURNAL_TARGETS);
+}
+
+/* Returns the sector holding logged sector IDX. */
+static inline disk_sector_t
+log_sector (size_t idx)
+{
+  return JOURNAL_SECTOR + 1 + desc_cnt () + idx;
+}
+
+/* Returns the number of sectors one transaction can log.  The
+   buffer cache commits only between file system operations, so a
+   transaction holds the metadata left dirty by earlier operations
+   plus one operation's worth.  An operation can rewrite every
+   free map sector and one indirect block for each
+   INODE_INDIRECT_BLOCKS (128) data sectors it writes, which
+   cannot exceed the disk, and JOURNAL_MIN covers the rest.
+   pintos-mkfs must agree. */
+size_t
+journal_capacity (void)
+{
+  size_t sectors = disk_size (filesys_disk);
+
+  return (JOURNAL_MIN + DIV_ROUND_UP (sectors, 128)
+          + DIV_ROUND_UP (sectors, DISK_SECTOR_SIZE * 8));
+}
+
+/* Returns the number of sectors the journal occupies, starting at
+   JOURNAL_SECTOR. */
+size_t
+journal_sectors (void)
+{
+  return 1 + desc_cnt () + journal_capacity ();
+}
+
+/* Writes a header describing CNT logged sectors.  CNT is 0 for an
+   empty journal. */
+static void
+header_write (size_t cnt)
+{
+  struct journal_header *h;
+
+  ASSERT (sizeof *h == DISK_SECTOR_SIZE);
+  ASSERT (cnt <= journal_capacity ());
+
+  h = calloc (1, sizeof *h);
+  if (h == NULL)
+    PANIC ("can't allocate journal header");
+  h->magic = JOURNAL_MAGIC;
+  h->cnt = cnt;
+  disk_write (filesys_disk, JOURNAL_SECTOR, h);
+  free (h);
+}
+
+/* Writes an empty journal at format time. */
+void
+journal_create (void)
+{
+  header_write (0);
+}
+
+/* Replays a transaction left in the journal by a crash, copying
+   each logged sector to its home, and then empties the journal.
+   Must run before anything is read through the buffer cache. */
+void
+journal_recover (void)
+{
+  struct journal_header *h;
+  disk_sector_t *targets;
+  void *buffer;
+  size_t i;
+
+  h = malloc (sizeof *h);
+  targets = malloc (DISK_SECTOR_SIZE);
+  buffer = malloc (DISK_SECTOR_SIZE);
+  if (h == NULL || targets == NULL || buffer == NULL)
+    PANIC ("can't allocate journal buffers");
+
+  disk_read (filesys_disk, JOURNAL_SECTOR, h);
+  if (h->magic == JOURNAL_MAGIC && h->cnt > 0
+      && h->cnt <= journal_capacity ())
+    {
+      printf ("Replaying %u journaled sectors...\n", (unsigned) h->cnt);
+      for (i = 0; i < h->cnt; i++)
+        {
+          if (i % JOURNAL_TARGETS == 0)
+            disk_read (filesys_disk, JOURNAL_SECTOR + 1 + i / JOURNAL_TARGETS,
+                       targets);
+          disk_read (filesys_disk, log_sector (i), buffer);
+          disk_write (filesys_disk, targets[i % JOURNAL_TARGETS], buffer);
+        }
+      journal_clear ();
+    }
+
+  free (buffer);
+  free (targets);
+  free (h);
+}
+
+/* Logs CNT sectors, whose contents are in BUFFERS and whose homes
+   are TARGETS, as one transaction.  The descriptors and sectors
+   are written sequentially to the log and then committed by
+   writing the header.  CNT must not exceed journal_capacity().
+   The caller must write the sectors home and then call
+   journal_clear() before logging the next transaction. */
+void
+journal_write (const disk_sector_t *targets, void *const *buffers,
+               size_t cnt)
+{
+  disk_sector_t *desc;
+  size_t i, n;
+
+  ASSERT (cnt <= journal_capacity ());
+
+  desc = malloc (DISK_SECTOR_SIZE);
+  if (desc == NULL)
+    PANIC ("can't allocate journal descriptor");
+  for (i = 0; i < cnt; i += JOURNAL_TARGETS)
+    {
+      n = cnt - i < JOURNAL_TARGETS ? cnt - i : JOURNAL_TARGETS;
+      memset (desc, 0, DISK_SECTOR_SIZE);
+      memcpy (desc, targets + i, n * sizeof *targets);
+      disk_write (filesys_disk, JOURNAL_SECTOR + 1 + i / JOURNAL_TARGETS,
+                  desc);
+    }
+  free (desc);
+
+  for (i = 0; i < cnt; i++)
+    disk_write (filesys_disk, log_sector (i), buffers[i]);
+  header_write (cnt);
+}
+
+/* Marks the journal empty once every logged sector is home. */
+void
+journal_clear (void)
+{
+  header_write (0);
+}
@@ -0,0 +1,20 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stddef.h>
+#include "devices/disk.h"
+
+/* Logged sectors every journal can hold on top of the ones it
+   needs for the free map and indirect blocks; see
+   journal_capacity(). */
+#define JOURNAL_MIN 64
+
+size_t journal_capacity (void);
+size_t journal_sectors (void);
+void journal_create (void);
+void journal_recover (void);
+void journal_write (const disk_sector_t *targets, void *const *buffers,
+                    size_t cnt);
+void journal_clear (void);
+
+#endif /* filesys/journal.h */
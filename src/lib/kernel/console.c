@@ -153,8 +153,9 @@ void
 putbuf (const char *buffer, size_t n)
 {
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  write_cnt += n;
+  serial_write ((const uint8_t *) buffer, n);
+  vga_write (buffer, n);
   release_console ();
 }
 
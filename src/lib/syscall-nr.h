@@ -28,7 +28,21 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions, numbered after the calls above so that those
+       keep their numbers. */
+    SYS_FSYNC,                  /* Makes a file's contents durable. */
+    SYS_GETDENTS,               /* Reads many directory entries. */
+    SYS_PREAD,                  /* Read from a file at a position. */
+    SYS_PWRITE,                 /* Write to a file at a position. */
+    SYS_READV,                  /* Read from a file into many buffers. */
+    SYS_WRITEV,                 /* Write to a file from many buffers. */
+    SYS_COPY_FILE_RANGE,        /* Copy data between two files. */
+    SYS_RING_ENTER,             /* Run queued system calls. */
+    SYS_SBRK,                   /* Grow or shrink the heap. */
+    SYS_MMAP_RANGE,             /* Map part of a file, or memory. */
+    SYS_FORK                    /* Duplicate the current process. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -30,8 +30,13 @@ hprintf (int handle, const char *format, ...)
 int
 puts (const char *s)
 {
-  write (STDOUT_FILENO, s, strlen (s));
-  putchar ('\n');
+  struct iovec iov[2];
+
+  iov[0].iov_base = (char *) s;
+  iov[0].iov_len = strlen (s);
+  iov[1].iov_base = "\n";
+  iov[1].iov_len = 1;
+  writev (STDOUT_FILENO, iov, 2);
 
   return 0;
 }
@@ -61,6 +61,45 @@
           retval;                                               \
         })
 
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   and ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; "    \
+             "pushl %[arg0]; pushl %[number]; int $0x30; "      \
+             "addl $20, %%esp"                                  \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "g" (ARG0),                             \
+                 [arg1] "g" (ARG1),                             \
+                 [arg2] "g" (ARG2),                             \
+                 [arg3] "g" (ARG3)                              \
+               : "memory");                                     \
+          retval;                                               \
+        })
+
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   ARG3, and ARG4, and returns the return value as an `int'. */
+#define syscall5(NUMBER, ARG0, ARG1, ARG2, ARG3, ARG4)          \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg4]; pushl %[arg3]; pushl %[arg2]; "    \
+             "pushl %[arg1]; pushl %[arg0]; pushl %[number]; "  \
+             "int $0x30; addl $24, %%esp"                       \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "g" (ARG0),                             \
+                 [arg1] "g" (ARG1),                             \
+                 [arg2] "g" (ARG2),                             \
+                 [arg3] "g" (ARG3),                             \
+                 [arg4] "g" (ARG4)                              \
+               : "memory");                                     \
+          retval;                                               \
+        })
+
 void
 halt (void)
 {
@@ -141,6 +180,42 @@ close (int fd)
   syscall1 (SYS_CLOSE, fd);
 }
 
+int
+pread (int fd, void *buffer, unsigned size, unsigned position)
+{
+  return syscall4 (SYS_PREAD, fd, buffer, size, position);
+}
+
+int
+pwrite (int fd, const void *buffer, unsigned size, unsigned position)
+{
+  return syscall4 (SYS_PWRITE, fd, buffer, size, position);
+}
+
+int
+readv (int fd, const struct iovec *iov, int cnt)
+{
+  return syscall3 (SYS_READV, fd, iov, cnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int cnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, cnt);
+}
+
+int
+copy_file_range (int fd_in, int fd_out, unsigned length)
+{
+  return syscall3 (SYS_COPY_FILE_RANGE, fd_in, fd_out, length);
+}
+
+int
+ring_enter (struct io_ring *ring)
+{
+  return syscall1 (SYS_RING_ENTER, ring);
+}
+
 mapid_t
 mmap (int fd, void *addr)
 {
@@ -153,6 +228,24 @@ munmap (mapid_t mapid)
   syscall1 (SYS_MUNMAP, mapid);
 }
 
+mapid_t
+mmap_range (void *addr, size_t length, int flags, int fd, unsigned offset)
+{
+  return syscall5 (SYS_MMAP_RANGE, addr, length, flags, fd, offset);
+}
+
+void *
+sbrk (intptr_t increment)
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
 bool
 chdir (const char *dir)
 {
@@ -182,3 +275,15 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+int
+getdents (int fd, struct dirent *ents, unsigned cnt)
+{
+  return syscall3 (SYS_GETDENTS, fd, ents, cnt);
+}
@@ -2,6 +2,8 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <debug.h>
 
 /* Process identifier. */
@@ -12,9 +14,64 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Flags for mmap_range(). */
+#define MAP_SHARED 0x1          /* Write changes back to the file. */
+#define MAP_PRIVATE 0x2         /* Keep changes to this process. */
+#define MAP_ANONYMOUS 0x4       /* Zero-filled memory, not a file. */
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* Directory entry written by getdents(). */
+struct dirent
+  {
+    int inumber;                        /* Inode number. */
+    bool is_dir;                        /* Is it a directory? */
+    char name[READDIR_MAX_LEN + 1];     /* Null terminated file name. */
+  };
+
+/* One buffer of a readv() or writev() call. */
+struct iovec
+  {
+    void *iov_base;                     /* Start of buffer. */
+    size_t iov_len;                     /* Length of buffer in bytes. */
+  };
+
+/* Maximum number of buffers in a readv() or writev() call. */
+#define IOV_MAX 64
+
+/* Number of entries in each queue of a struct io_ring. */
+#define IO_RING_ENTRIES 64
+
+/* A queued system call. */
+struct io_sqe
+  {
+    int opcode;                         /* System call number. */
+    unsigned args[4];                   /* Its arguments. */
+    unsigned user_data;                 /* Passed back in the completion. */
+  };
+
+/* The result of a queued system call. */
+struct io_cqe
+  {
+    int result;                         /* Return value, or -1. */
+    unsigned user_data;                 /* From the submission. */
+  };
+
+/* Submission and completion queues shared between a process and
+   the kernel, for ring_enter().  The process fills sq[] and
+   advances sq_tail; the kernel advances sq_head as it consumes
+   entries and posts results at cq_tail, which the process
+   consumes by advancing cq_head.  Indexes run freely and are
+   taken modulo IO_RING_ENTRIES. */
+struct io_ring
+  {
+    unsigned sq_head, sq_tail;          /* Submission queue indexes. */
+    unsigned cq_head, cq_tail;          /* Completion queue indexes. */
+    struct io_sqe sq[IO_RING_ENTRIES];  /* Submission queue. */
+    struct io_cqe cq[IO_RING_ENTRIES];  /* Completion queue. */
+  };
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -33,10 +90,20 @@ int write (int fd, const void *buffer, unsigned length);
 void seek (int fd, unsigned position);
 unsigned tell (int fd);
 void close (int fd);
+int pread (int fd, void *buffer, unsigned length, unsigned position);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned position);
+int readv (int fd, const struct iovec *, int cnt);
+int writev (int fd, const struct iovec *, int cnt);
+int copy_file_range (int fd_in, int fd_out, unsigned length);
+int ring_enter (struct io_ring *);
 
 /* Project 3 and optionally project 4. */
 mapid_t mmap (int fd, void *addr);
 void munmap (mapid_t);
+mapid_t mmap_range (void *addr, size_t length, int flags, int fd,
+                    unsigned offset);
+void *sbrk (intptr_t increment);
+pid_t fork (void);
 
 /* Project 4 only. */
 bool chdir (const char *dir);
@@ -44,5 +111,7 @@ bool mkdir (const char *dir);
 bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
+bool fsync (int fd);
+int getdents (int fd, struct dirent *, unsigned cnt);
 
 #endif /* lib/user/syscall.h */
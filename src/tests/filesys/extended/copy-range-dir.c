@@ -0,0 +1,29 @@
+/* Tries to copy between a file and a directory with
+   copy_file_range(), which must fail without moving either file
+   position. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  int dir_fd, fd;
+  int retval;
+
+  CHECK (mkdir ("d"), "mkdir \"d\"");
+  CHECK ((dir_fd = open ("d")) > 1, "open \"d\"");
+  CHECK (create ("f", 0), "create \"f\"");
+  CHECK ((fd = open ("f")) > 1, "open \"f\"");
+  CHECK (write (fd, "foobar", 6) == 6, "write \"f\"");
+  seek (fd, 0);
+
+  retval = copy_file_range (fd, dir_fd, 6);
+  CHECK (retval == -1,
+         "copy \"f\" to \"d\" (must return -1, actually %d)", retval);
+  retval = copy_file_range (dir_fd, fd, 6);
+  CHECK (retval == -1,
+         "copy \"d\" to \"f\" (must return -1, actually %d)", retval);
+  CHECK (tell (fd) == 0, "file position unchanged");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(copy-range-dir) begin
+(copy-range-dir) mkdir "d"
+(copy-range-dir) open "d"
+(copy-range-dir) create "f"
+(copy-range-dir) open "f"
+(copy-range-dir) write "f"
+(copy-range-dir) copy "f" to "d" (must return -1, actually -1)
+(copy-range-dir) copy "d" to "f" (must return -1, actually -1)
+(copy-range-dir) file position unchanged
+(copy-range-dir) end
+EOF
+pass;
@@ -0,0 +1,47 @@
+/* Reads a directory with getdents() and checks each entry's name,
+   type, and inode number. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  struct dirent ents[8];
+  int dir_fd, fd;
+  int cnt, i;
+  bool seen_d = false, seen_f = false;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (mkdir ("a/d"), "mkdir \"a/d\"");
+  CHECK (create ("a/f", 0), "create \"a/f\"");
+  CHECK ((dir_fd = open ("a")) > 1, "open \"a\"");
+
+  cnt = getdents (dir_fd, ents, 8);
+  CHECK (cnt == 2, "getdents \"a\" (must return 2, actually %d)", cnt);
+  for (i = 0; i < cnt; i++)
+    {
+      if (!strcmp (ents[i].name, "d") && ents[i].is_dir)
+        seen_d = true;
+      else if (!strcmp (ents[i].name, "f") && !ents[i].is_dir)
+        {
+          fd = open ("a/f");
+          if (fd < 2 || inumber (fd) != ents[i].inumber)
+            fail ("wrong inode number for \"f\"");
+          close (fd);
+          seen_f = true;
+        }
+      else
+        fail ("unexpected entry \"%s\"", ents[i].name);
+    }
+  if (!seen_d || !seen_f)
+    fail ("missing entry");
+
+  cnt = getdents (dir_fd, ents, 8);
+  CHECK (cnt == 0, "getdents \"a\" at end (must return 0, actually %d)",
+         cnt);
+  msg ("close \"a\"");
+  close (dir_fd);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) mkdir "a"
+(dir-getdents) mkdir "a/d"
+(dir-getdents) create "a/f"
+(dir-getdents) open "a"
+(dir-getdents) getdents "a" (must return 2, actually 2)
+(dir-getdents) getdents "a" at end (must return 0, actually 0)
+(dir-getdents) close "a"
+(dir-getdents) end
+EOF
+pass;
@@ -0,0 +1,24 @@
+/* Writes a file, forces it to disk with fsync(), and checks that
+   the contents read back unchanged. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[1234];
+
+void
+test_main (void)
+{
+  int fd;
+
+  memset (buf, 'f', sizeof buf);
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf, "write \"data\"");
+  CHECK (fsync (fd), "fsync \"data\"");
+  msg ("close \"data\"");
+  close (fd);
+  check_file ("data", buf, sizeof buf);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fsync-normal) begin
+(fsync-normal) create "data"
+(fsync-normal) open "data"
+(fsync-normal) write "data"
+(fsync-normal) fsync "data"
+(fsync-normal) close "data"
+(fsync-normal) open "data" for verification
+(fsync-normal) verified contents of "data"
+(fsync-normal) close "data"
+(fsync-normal) end
+EOF
+pass;
@@ -0,0 +1,6 @@
+/* Grows a file from 0 bytes to 72,943 bytes, 1,234 bytes at a
+   time, on a file system formatted with 8-sector (4 kB) data
+   blocks, so that most writes fill part of a block. */
+
+#define TEST_SIZE 72943
+#include "tests/filesys/extended/grow-seq.inc"
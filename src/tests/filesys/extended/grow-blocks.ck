@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-blocks) begin
+(grow-blocks) create "testme"
+(grow-blocks) open "testme"
+(grow-blocks) writing "testme"
+(grow-blocks) close "testme"
+(grow-blocks) open "testme" for verification
+(grow-blocks) verified contents of "testme"
+(grow-blocks) close "testme"
+(grow-blocks) end
+EOF
+pass;
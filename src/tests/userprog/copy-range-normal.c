@@ -0,0 +1,35 @@
+/* Copies the tail of a file into another with copy_file_range()
+   and checks the data and both file positions. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char expected[sizeof sample - 1];
+  size_t size = sizeof sample - 1;
+  int in, out, byte_cnt;
+
+  CHECK ((in = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (create ("test.txt", size), "create \"test.txt\"");
+  CHECK ((out = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  /* Ask for more than is left, so the copy stops at end of file. */
+  seek (in, 10);
+  byte_cnt = copy_file_range (in, out, size);
+  if (byte_cnt != (int) size - 10)
+    fail ("copy_file_range() returned %d instead of %zu",
+          byte_cnt, size - 10);
+  CHECK (tell (in) == size && tell (out) == size - 10,
+         "file positions advanced");
+  msg ("close \"test.txt\"");
+  close (out);
+
+  memset (expected, 0, sizeof expected);
+  memcpy (expected, sample + 10, size - 10);
+  check_file ("test.txt", expected, size);
+}
@@ -0,0 +1,19 @@
+/* Passes getdents() a buffer that starts just below PHYS_BASE,
+   with a count so large that the end of the buffer wraps around
+   to a user address.  The process must be terminated with -1
+   exit code. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  getdents (handle, (struct dirent *) 0xbffffff0, 0x0ccccccd);
+  fail ("should not have survived getdents()");
+}
@@ -0,0 +1,23 @@
+/* Reads part of a file with pread() and checks that the file
+   position is left alone. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char buf[32];
+  int handle, byte_cnt;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  seek (handle, 5);
+
+  byte_cnt = pread (handle, buf, sizeof buf, 40);
+  if (byte_cnt != sizeof buf)
+    fail ("pread() returned %d instead of %zu", byte_cnt, sizeof buf);
+  compare_bytes (buf, sample + 40, sizeof buf, 40, "sample.txt");
+  CHECK (tell (handle) == 5, "file position unchanged");
+}
@@ -0,0 +1,18 @@
+/* Passes pwrite() a buffer that starts in user memory but runs
+   past PHYS_BASE.  The process must be terminated with -1 exit
+   code. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  pwrite (handle, (char *) 0xbffffff0, 100, 0);
+  fail ("should not have survived pwrite()");
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pwrite-bad-ptr) begin
+(pwrite-bad-ptr) open "sample.txt"
+pwrite-bad-ptr: exit(-1)
+EOF
+pass;
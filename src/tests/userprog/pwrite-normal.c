@@ -0,0 +1,30 @@
+/* Writes a file back to front with pwrite() and checks that the
+   file position is left alone and the contents are right. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  size_t size = sizeof sample - 1;
+  size_t half = size / 2;
+  int handle, byte_cnt;
+
+  CHECK (create ("test.txt", size), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  byte_cnt = pwrite (handle, sample + half, size - half, half);
+  if (byte_cnt != (int) (size - half))
+    fail ("pwrite() returned %d instead of %zu", byte_cnt, size - half);
+  byte_cnt = pwrite (handle, sample, half, 0);
+  if (byte_cnt != (int) half)
+    fail ("pwrite() returned %d instead of %zu", byte_cnt, half);
+  CHECK (tell (handle) == 0, "file position unchanged");
+  msg ("close \"test.txt\"");
+  close (handle);
+
+  check_file ("test.txt", sample, size);
+}
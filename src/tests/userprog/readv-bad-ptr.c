@@ -0,0 +1,23 @@
+/* Passes readv() a buffer in kernel memory.  The process must be
+   terminated with -1 exit code. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char buf[16];
+  struct iovec iov[2];
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  iov[0].iov_base = buf;
+  iov[0].iov_len = sizeof buf;
+  iov[1].iov_base = (char *) 0xc0100000;
+  iov[1].iov_len = 123;
+  readv (handle, iov, 2);
+  fail ("should not have survived readv()");
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(readv-bad-ptr) begin
+(readv-bad-ptr) open "sample.txt"
+readv-bad-ptr: exit(-1)
+EOF
+pass;
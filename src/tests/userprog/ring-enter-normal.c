@@ -0,0 +1,66 @@
+/* Queues system calls to ring_enter() in two batches and checks
+   each completion, including one for a call that may not be
+   queued. */
+
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static struct io_ring ring;
+
+/* Queues system call OPCODE with arguments A0...A2. */
+static void
+submit (int opcode, unsigned a0, unsigned a1, unsigned a2)
+{
+  struct io_sqe *sqe = &ring.sq[ring.sq_tail % IO_RING_ENTRIES];
+
+  sqe->opcode = opcode;
+  sqe->args[0] = a0;
+  sqe->args[1] = a1;
+  sqe->args[2] = a2;
+  sqe->user_data = ring.sq_tail;
+  ring.sq_tail++;
+}
+
+/* Consumes the next completion, failing unless it is for
+   submission USER_DATA, and returns its result. */
+static int
+complete (unsigned user_data)
+{
+  struct io_cqe *cqe = &ring.cq[ring.cq_head % IO_RING_ENTRIES];
+
+  if (ring.cq_head == ring.cq_tail)
+    fail ("completion queue empty");
+  if (cqe->user_data != user_data)
+    fail ("completion for %u, expected %u", cqe->user_data, user_data);
+  ring.cq_head++;
+  return cqe->result;
+}
+
+void
+test_main (void)
+{
+  size_t size = sizeof sample - 1;
+  int handle;
+
+  submit (SYS_CREATE, (unsigned) "test.txt", size, 0);
+  submit (SYS_OPEN, (unsigned) "test.txt", 0, 0);
+  CHECK (ring_enter (&ring) == 2, "ring_enter create and open");
+  CHECK (complete (0) == 1, "create \"test.txt\"");
+  CHECK ((handle = complete (1)) > 1, "open \"test.txt\"");
+
+  submit (SYS_WRITE, handle, (unsigned) sample, size);
+  submit (SYS_EXEC, (unsigned) "child-simple", 0, 0);
+  submit (SYS_TELL, handle, 0, 0);
+  CHECK (ring_enter (&ring) == 3, "ring_enter write, exec, and tell");
+  CHECK (complete (2) == (int) size, "write \"test.txt\"");
+  CHECK (complete (3) == -1, "exec may not be queued");
+  CHECK (complete (4) == (int) size, "tell \"test.txt\"");
+  CHECK (ring.sq_head == ring.sq_tail, "submission queue consumed");
+
+  msg ("close \"test.txt\"");
+  close (handle);
+  check_file ("test.txt", sample, size);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-enter-normal) begin
+(ring-enter-normal) ring_enter create and open
+(ring-enter-normal) create "test.txt"
+(ring-enter-normal) open "test.txt"
+(ring-enter-normal) ring_enter write, exec, and tell
+(ring-enter-normal) write "test.txt"
+(ring-enter-normal) exec may not be queued
+(ring-enter-normal) tell "test.txt"
+(ring-enter-normal) submission queue consumed
+(ring-enter-normal) close "test.txt"
+(ring-enter-normal) open "test.txt" for verification
+(ring-enter-normal) verified contents of "test.txt"
+(ring-enter-normal) close "test.txt"
+(ring-enter-normal) end
+ring-enter-normal: exit(0)
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Writes a file, and then the console, from three buffers with
+   one writev() call each. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  struct iovec iov[3];
+  size_t size = sizeof sample - 1;
+  int handle, byte_cnt;
+
+  CHECK (create ("test.txt", size), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  iov[0].iov_base = sample;
+  iov[0].iov_len = 10;
+  iov[1].iov_base = sample + 10;
+  iov[1].iov_len = 0;
+  iov[2].iov_base = sample + 10;
+  iov[2].iov_len = size - 10;
+  byte_cnt = writev (handle, iov, 3);
+  if (byte_cnt != (int) size)
+    fail ("writev() returned %d instead of %zu", byte_cnt, size);
+  msg ("close \"test.txt\"");
+  close (handle);
+  check_file ("test.txt", sample, size);
+
+  iov[0].iov_base = "writev ";
+  iov[0].iov_len = 7;
+  iov[1].iov_base = "to the ";
+  iov[1].iov_len = 7;
+  iov[2].iov_base = "console\n";
+  iov[2].iov_len = 8;
+  byte_cnt = writev (STDOUT_FILENO, iov, 3);
+  if (byte_cnt != 22)
+    fail ("writev() returned %d instead of 22", byte_cnt);
+}
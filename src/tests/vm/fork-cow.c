@@ -0,0 +1,50 @@
+/* Forks twice and checks that parent and child each see only
+   their own writes to memory they started out sharing: first the
+   child writes, then the parent writes while the child reads. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 4096)
+
+static char buf[SIZE];
+
+/* Returns true if every byte of BUF is C. */
+static bool
+all (char c)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != c)
+      return false;
+  return true;
+}
+
+void
+test_main (void)
+{
+  pid_t pid;
+
+  memset (buf, 'a', SIZE);
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      memset (buf, 'c', SIZE);
+      exit (all ('c') ? 81 : 1);
+    }
+  CHECK (pid != PID_ERROR, "fork child that writes");
+  CHECK (wait (pid) == 81, "wait for child");
+  CHECK (all ('a'), "parent's memory unchanged");
+
+  pid = fork ();
+  if (pid == 0)
+    exit (all ('a') ? 82 : 1);
+  memset (buf, 'p', SIZE);
+  CHECK (pid != PID_ERROR, "fork child that reads");
+  CHECK (wait (pid) == 82, "wait for child");
+  CHECK (all ('p'), "parent's memory holds its writes");
+}
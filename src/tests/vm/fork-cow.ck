@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-cow) begin
+(fork-cow) fork child that writes
+(fork-cow) wait for child
+(fork-cow) parent's memory unchanged
+(fork-cow) fork child that reads
+(fork-cow) wait for child
+(fork-cow) parent's memory holds its writes
+(fork-cow) end
+EOF
+pass;
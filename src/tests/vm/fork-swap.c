@@ -0,0 +1,50 @@
+/* Forks with 2 MB of memory shared copy-on-write, more than fits
+   in physical memory, so that shared frames must be evicted to
+   swap.  The child checks and then overwrites the buffer, and the
+   parent checks that its copy survived. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+
+static char buf[SIZE];
+
+/* Returns true if BUF holds the pattern written by test_main(). */
+static bool
+pattern_ok (void)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char) (i % 251))
+      return false;
+  return true;
+}
+
+void
+test_main (void)
+{
+  pid_t pid;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i % 251;
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      if (!pattern_ok ())
+        exit (1);
+      memset (buf, 'c', SIZE);
+      for (i = 0; i < SIZE; i++)
+        if (buf[i] != 'c')
+          exit (2);
+      exit (81);
+    }
+  CHECK (pid != PID_ERROR, "fork");
+  CHECK (wait (pid) == 81, "wait for child");
+  CHECK (pattern_ok (), "parent's memory unchanged");
+}
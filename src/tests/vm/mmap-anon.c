@@ -0,0 +1,33 @@
+/* Maps zero-filled anonymous memory with mmap_range(), checks
+   that it reads as zeros, and writes and reads it back. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define SIZE (3 * 4096)
+
+void
+test_main (void)
+{
+  mapid_t map;
+  size_t i;
+
+  CHECK ((map = mmap_range (ACTUAL, SIZE, MAP_PRIVATE | MAP_ANONYMOUS,
+                            -1, 0)) != MAP_FAILED,
+         "mmap anonymous memory");
+  for (i = 0; i < SIZE; i++)
+    if (ACTUAL[i] != 0)
+      fail ("byte %zu is %02hhx, not zero", i, ACTUAL[i]);
+  msg ("memory is zeroed");
+
+  for (i = 0; i < SIZE; i++)
+    ACTUAL[i] = i % 251;
+  for (i = 0; i < SIZE; i++)
+    if (ACTUAL[i] != (char) (i % 251))
+      fail ("byte %zu is %02hhx, not %02zx", i, ACTUAL[i], i % 251);
+  msg ("memory holds written data");
+  munmap (map);
+}
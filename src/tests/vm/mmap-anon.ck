@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-anon) begin
+(mmap-anon) mmap anonymous memory
+(mmap-anon) memory is zeroed
+(mmap-anon) memory holds written data
+(mmap-anon) end
+EOF
+pass;
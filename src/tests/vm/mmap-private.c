@@ -0,0 +1,28 @@
+/* Maps a file privately with mmap_range(), writes to the
+   mapping, and verifies that the file itself is not changed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap_range (ACTUAL, 4096, MAP_PRIVATE, handle, 0))
+         != MAP_FAILED, "mmap \"sample.txt\" privately");
+  CHECK (!memcmp (ACTUAL, sample, strlen (sample)),
+         "mapping holds file data");
+  memset (ACTUAL, 'x', strlen (sample));
+  CHECK (ACTUAL[0] == 'x', "mapping holds written data");
+  munmap (map);
+
+  check_file_handle (handle, "sample.txt", sample, strlen (sample));
+}
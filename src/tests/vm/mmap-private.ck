@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-private) begin
+(mmap-private) open "sample.txt"
+(mmap-private) mmap "sample.txt" privately
+(mmap-private) mapping holds file data
+(mmap-private) mapping holds written data
+(mmap-private) verified contents of "sample.txt"
+(mmap-private) end
+EOF
+pass;
@@ -0,0 +1,74 @@
+/* Allocates blocks of many sizes, small and spanning pages, with
+   malloc() and realloc(), checks that each keeps its contents,
+   frees them all in shuffled order, and verifies that the heap
+   shrinks back to within a page of where it started. */
+
+#include <malloc.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define BLOCK_CNT 64
+
+static char *blocks[BLOCK_CNT];
+static size_t sizes[BLOCK_CNT];
+
+/* Fails unless block I holds SIZE bytes with value I. */
+static void
+verify (size_t i, size_t size)
+{
+  size_t j;
+
+  for (j = 0; j < size; j++)
+    if (blocks[i][j] != (char) i)
+      fail ("block %zu byte %zu is %02hhx", i, j, blocks[i][j]);
+}
+
+void
+test_main (void)
+{
+  char *start = sbrk (0);
+  size_t order[BLOCK_CNT];
+  size_t i;
+
+  msg ("malloc");
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      sizes[i] = i * 331 % (3 * PAGE_SIZE) + 1;
+      blocks[i] = malloc (sizes[i]);
+      if (blocks[i] == NULL)
+        fail ("malloc of %zu bytes failed", sizes[i]);
+      memset (blocks[i], i, sizes[i]);
+    }
+  CHECK ((char *) sbrk (0) > start, "heap grew");
+
+  msg ("verify");
+  for (i = 0; i < BLOCK_CNT; i++)
+    verify (i, sizes[i]);
+
+  msg ("realloc");
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    {
+      blocks[i] = realloc (blocks[i], sizes[i] * 2);
+      if (blocks[i] == NULL)
+        fail ("realloc of %zu bytes failed", sizes[i] * 2);
+      verify (i, sizes[i]);
+      memset (blocks[i], i, sizes[i] * 2);
+      sizes[i] *= 2;
+    }
+
+  msg ("verify");
+  for (i = 0; i < BLOCK_CNT; i++)
+    verify (i, sizes[i]);
+
+  msg ("free");
+  for (i = 0; i < BLOCK_CNT; i++)
+    order[i] = i;
+  shuffle (order, BLOCK_CNT, sizeof *order);
+  for (i = 0; i < BLOCK_CNT; i++)
+    free (blocks[order[i]]);
+  CHECK ((char *) sbrk (0) < start + PAGE_SIZE, "heap shrank back");
+}
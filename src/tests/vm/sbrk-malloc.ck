@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sbrk-malloc) begin
+(sbrk-malloc) malloc
+(sbrk-malloc) heap grew
+(sbrk-malloc) verify
+(sbrk-malloc) realloc
+(sbrk-malloc) verify
+(sbrk-malloc) free
+(sbrk-malloc) heap shrank back
+(sbrk-malloc) end
+EOF
+pass;
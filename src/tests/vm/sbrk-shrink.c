@@ -0,0 +1,44 @@
+/* Grows the heap by three pages with sbrk(), shrinks it by two,
+   and verifies that the page left below the break keeps its
+   contents, that a page given back comes back zeroed, and that
+   touching a page given back terminates the process. */
+
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+
+void
+test_main (void)
+{
+  char *brk = sbrk (0);
+  char *heap;
+  size_t pad, i;
+
+  pad = (PAGE_SIZE - (uintptr_t) brk % PAGE_SIZE) % PAGE_SIZE;
+  CHECK (sbrk (pad) == brk, "align break to a page");
+  heap = brk + pad;
+
+  CHECK (sbrk (3 * PAGE_SIZE) == heap, "grow heap by 3 pages");
+  memset (heap, 0x5a, 3 * PAGE_SIZE);
+  CHECK (sbrk (-2 * PAGE_SIZE) == heap + 3 * PAGE_SIZE,
+         "shrink heap by 2 pages");
+  CHECK (sbrk (0) == heap + PAGE_SIZE, "break is 1 page past start");
+
+  msg ("verify first page");
+  for (i = 0; i < PAGE_SIZE; i++)
+    if (heap[i] != 0x5a)
+      fail ("byte %zu of first page is %02hhx", i, heap[i]);
+
+  CHECK (sbrk (PAGE_SIZE) == heap + PAGE_SIZE, "grow heap by 1 page");
+  msg ("verify regrown page");
+  for (i = PAGE_SIZE; i < 2 * PAGE_SIZE; i++)
+    if (heap[i] != 0)
+      fail ("byte %zu of regrown page is %02hhx", i, heap[i]);
+
+  msg ("read page given back");
+  fail ("page given back is readable (%d)", heap[2 * PAGE_SIZE]);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_USER_FAULTS => 1, [<<'EOF']);
+(sbrk-shrink) begin
+(sbrk-shrink) align break to a page
+(sbrk-shrink) grow heap by 3 pages
+(sbrk-shrink) shrink heap by 2 pages
+(sbrk-shrink) break is 1 page past start
+(sbrk-shrink) verify first page
+(sbrk-shrink) grow heap by 1 page
+(sbrk-shrink) verify regrown page
+(sbrk-shrink) read page given back
+sbrk-shrink: exit(-1)
+EOF
+pass;
@@ -36,6 +36,8 @@
 #include "filesys/fsutil.h"
 #endif
 #ifdef VM
+#include "vm/page.h"
+#include "vm/share.h"
 #include "vm/swap.h"
 #endif
 
@@ -121,6 +123,7 @@ main (void)
 #endif
 #ifdef VM
   swap_init ();
+  share_init ();
 #endif
 
   printf ("Boot complete.\n");
@@ -247,6 +250,14 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-fb"))
+        {
+          filesys_block_sectors = atoi (value);
+          if (filesys_block_sectors < 1
+              || filesys_block_sectors > FILESYS_BLOCK_SECTORS_MAX)
+            PANIC ("block size must be 1 to %d sectors",
+                   FILESYS_BLOCK_SECTORS_MAX);
+        }
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
@@ -255,6 +266,16 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-fa"))
+        {
+          page_fault_around = atoi (value);
+          if (page_fault_around < 1
+              || page_fault_around > PAGE_FAULT_AROUND_MAX)
+            PANIC ("fault-around must be 1 to %d pages",
+                   PAGE_FAULT_AROUND_MAX);
+        }
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -355,10 +376,16 @@ usage (void)
           "  -h                 Print this help message and power off.\n"
           "  -q                 Power off VM after actions or on panic.\n"
           "  -f                 Format file system disk during startup.\n"
+#ifdef FILESYS
+          "  -fb=SECTORS        Format with SECTORS-sector data blocks (default 1).\n"
+#endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+          "  -fa=PAGES          Map up to PAGES file pages per page fault.\n"
 #endif
           );
   power_off ();
@@ -402,5 +429,6 @@ print_stats (void)
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
+  syscall_print_stats ();
 #endif
 }
@@ -513,8 +513,9 @@ init_thread (struct thread *t, const char *name, int priority)
   t->exit_status = -1;
 #ifdef USERPROG
   sema_init (&t->load_sema, 0);
-  t->max_fd = 2;
-  list_init (&t->fd_list);
+  t->fds = NULL;
+  t->fd_cnt = 0;
+  t->fd_next = 2;
   list_init (&t->child_list);
 #endif
 #ifdef FILESYS
@@ -108,8 +108,9 @@ struct thread
     struct file *executable;            /* Executable file. */
     enum load_status child_status;      /* The load status of child thread. */
     struct semaphore load_sema;         /* The semaphore for child_status. */
-    int max_fd;                         /* The largest file descriptor. */
-    struct list fd_list;                /* List of file descriptors. */
+    struct file **fds;                  /* Open files, indexed by fd. */
+    int fd_cnt;                         /* Number of slots in fds. */
+    int fd_next;                        /* No free fd is below this. */
     struct thread *parent;              /* Parent thread. */
     struct list child_list;             /* List of child threads. */
     void *esp;                          /* ESP register. */
@@ -119,6 +120,8 @@ struct thread
     struct hash page_table;             /* Supplemental page table. */
     int max_mapid;                      /* The largest mapping identifier. */
     struct list mmap_list;              /* List of memory mapped files. */
+    uint8_t *heap_start;                /* Start of the heap. */
+    uint8_t *heap_brk;                  /* Program break. */
 #endif
 
 #ifdef FILESYS
@@ -136,14 +139,6 @@ struct thread
     int base_priority;                  /* Priority before donation. */
   };
 
-/* File descriptor of thread. */
-struct thread_fd
-  {
-    int fd;                             /* File descriptor. */
-    struct file *file;                  /* The file. */
-    struct list_elem elem;              /* List element. */
-  };
-
 /* Child thread. */
 struct thread_child
   {
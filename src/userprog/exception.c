@@ -11,10 +11,9 @@
 #include "userprog/pagedir.h"
 #include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/share.h"
 #endif
 
-#define MAX_STACK_SIZE 8 * 1024 * 1024
-
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
@@ -141,6 +140,7 @@ page_fault (struct intr_frame *f)
   struct page *page;
   uint8_t *upage;
   uint8_t *kpage;
+  struct page_readahead ra;
   bool success = false;
 #endif
 
@@ -166,24 +166,46 @@ page_fault (struct intr_frame *f)
   user = (f->error_code & PF_U) != 0;
 
 #ifdef VM
-  if (not_present)
+  if (!not_present && write)
+    {
+      /* Copy-on-write. */
+      t = thread_current ();
+      frame_acquire ();
+      page = page_find (&t->page_table, pg_round_down (fault_addr));
+      success = page != NULL && share_write (page);
+      frame_release ();
+      if (success)
+        return;
+    }
+  else if (not_present)
     {
       t = thread_current ();
       upage = pg_round_down (fault_addr);
 
       /* Check supplemental page table. */
+      ra.file = NULL;
       frame_acquire ();
       page = page_find (&t->page_table, upage);
       if (page != NULL)
         {
+          /* Wait for any eviction of the page to finish. */
+          page_wait (page);
+
+          /* Copy-on-write frame, evicted to swap. */
+          if (page->share != NULL)
+            success = share_fault (page);
           /* Swap. */
-          if (!page->valid)
+          else if (!page->valid)
             success = page_load_swap (page);
           else if (!page->loaded)
             {
               /* File. */
               if (page->file != NULL)
-                success = page_load_file (page);
+                {
+                  success = page_load_file (page);
+                  if (success && page_fault_around > 1)
+                    page_load_around (page, &ra);
+                }
               /* Zero. */
               else
                 success = page_load_zero (page);
@@ -195,6 +217,7 @@ page_fault (struct intr_frame *f)
           if (success)
             {
               frame_release ();
+              page_read_ahead (&ra);
               return;
             }
         }
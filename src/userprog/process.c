@@ -26,6 +26,10 @@
 #endif
 
 static thread_func start_process NO_RETURN;
+#ifdef VM
+static thread_func start_fork NO_RETURN;
+static bool fork_files (struct thread *parent);
+#endif
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
 
 /* Starts a new thread running a user program loaded from
@@ -89,6 +93,7 @@ start_process (void *f_name)
   /* Initialize the list of memory mapped files. */
   curr->max_mapid = 0;
   list_init (&curr->mmap_list);
+  curr->heap_start = curr->heap_brk = NULL;
 #endif
 
   /* Initialize interrupt frame and load executable. */
@@ -122,6 +127,124 @@ start_process (void *f_name)
   NOT_REACHED ();
 }
 
+#ifdef VM
+/* Starts a new thread running a copy of the current user
+   process, which is in a system call.  The new thread may be
+   scheduled (and may even exit) before process_fork() returns.
+   Returns the new process's thread id, or TID_ERROR if the
+   thread cannot be created. */
+tid_t
+process_fork (void)
+{
+  struct thread *curr = thread_current ();
+  struct intr_frame *if_;
+  tid_t tid;
+
+  /* The user process's registers were saved at the top of its
+     kernel stack on entry to the system call. */
+  if_ = (struct intr_frame *) ((uint8_t *) curr + PGSIZE) - 1;
+
+  tid = thread_create (curr->name, PRI_DEFAULT, start_fork, if_);
+  if (tid == TID_ERROR)
+    {
+      curr->child_status = FAILED;
+      sema_up (&curr->load_sema);
+    }
+
+  return tid;
+}
+
+/* A thread function that copies the address space and open
+   files of the parent process, which waits on its load_sema
+   meanwhile, and returns to user mode where the parent made the
+   system call, with a return value of 0. */
+static void
+start_fork (void *parent_if)
+{
+  struct thread *curr = thread_current ();
+  struct thread *parent = curr->parent;
+  struct intr_frame if_;
+  bool success;
+
+  memcpy (&if_, parent_if, sizeof if_);
+  if_.eax = 0;
+
+  /* Initialize supplemental page table. */
+  if (!page_init (&curr->page_table))
+    {
+      parent->child_status = FAILED;
+      sema_up (&parent->load_sema);
+      sys_exit (-1);
+    }
+  curr->max_mapid = parent->max_mapid;
+  list_init (&curr->mmap_list);
+  curr->heap_start = parent->heap_start;
+  curr->heap_brk = parent->heap_brk;
+
+  curr->pagedir = pagedir_create ();
+  success = curr->pagedir != NULL;
+  if (success)
+    {
+      process_activate ();
+      filesys_acquire ();
+      success = fork_files (parent);
+      filesys_release ();
+    }
+  if (success)
+    {
+      frame_acquire ();
+      success = page_fork (parent);
+      frame_release ();
+    }
+
+  if (!success)
+    {
+      parent->child_status = FAILED;
+      sema_up (&parent->load_sema);
+      sys_exit (-1);
+    }
+  parent->child_status = LOADED;
+  sema_up (&parent->load_sema);
+
+  /* Start the user process as start_process() does. */
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Gives the current process its own handles on the executable
+   and open files of PARENT.  The handles have their own file
+   positions, starting at the parent's.  The caller must hold the
+   file system lock.  Returns true if successful. */
+static bool
+fork_files (struct thread *parent)
+{
+  struct thread *curr = thread_current ();
+  int fd;
+
+  curr->executable = file_reopen (parent->executable);
+  if (curr->executable == NULL)
+    return false;
+  file_deny_write (curr->executable);
+
+  if (parent->fd_cnt == 0)
+    return true;
+  curr->fds = calloc (parent->fd_cnt, sizeof *curr->fds);
+  if (curr->fds == NULL)
+    return false;
+  curr->fd_cnt = parent->fd_cnt;
+  curr->fd_next = parent->fd_next;
+  for (fd = 2; fd < parent->fd_cnt; fd++)
+    if (parent->fds[fd] != NULL)
+      {
+        curr->fds[fd] = file_reopen (parent->fds[fd]);
+        if (curr->fds[fd] == NULL)
+          return false;
+        file_seek (curr->fds[fd], file_tell (parent->fds[fd]));
+      }
+  return true;
+}
+#endif
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -163,36 +286,28 @@ void
 process_exit (void)
 {
   struct thread *curr = thread_current ();
-  struct thread_fd *tfd;
   uint32_t *pd;
   struct list_elem *e;
   struct thread_child *child;
-
-  if (!list_empty (&curr->fd_list))
-    {
-      e = list_front (&curr->fd_list);
-      while (e != list_end (&curr->fd_list))
-        {
-          tfd = list_entry (e, struct thread_fd, elem);
-          e = list_remove (e);
-          if (tfd->file != NULL)
-            {
-              filesys_acquire ();
-              file_close (tfd->file);
-              filesys_release ();
-            }
-          free (tfd);
-        }
-    }
+  int fd;
+
+  for (fd = 2; fd < curr->fd_cnt; fd++)
+    if (curr->fds[fd] != NULL)
+      {
+        filesys_acquire ();
+        file_close (curr->fds[fd]);
+        filesys_release ();
+      }
+  free (curr->fds);
+  curr->fds = NULL;
+  curr->fd_cnt = 0;
   filesys_acquire ();
   file_close (curr->executable);
   filesys_release ();
 
 #ifdef VM
   frame_acquire ();
-  filesys_acquire ();
   page_destroy (&curr->page_table);
-  filesys_release ();
   frame_release ();
 #endif
 
@@ -426,6 +541,13 @@ load (const char *file_name, void (**eip) (void), void **esp)
               if (!load_segment (file, file_page, (void *) mem_page,
                                  read_bytes, zero_bytes, writable))
                 goto done;
+#ifdef VM
+              /* The heap starts after the highest segment. */
+              if ((uint8_t *) mem_page + read_bytes + zero_bytes
+                  > t->heap_start)
+                t->heap_start = t->heap_brk = ((uint8_t *) mem_page
+                                               + read_bytes + zero_bytes);
+#endif
             }
           else
             goto done;
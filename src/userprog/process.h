@@ -7,5 +7,8 @@ tid_t process_execute (const char *file_name);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
+#ifdef VM
+tid_t process_fork (void);
+#endif
 
 #endif /* userprog/process.h */
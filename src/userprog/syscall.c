@@ -1,4 +1,5 @@
 #include "userprog/syscall.h"
+#include <limits.h>
 #include <stdio.h>
 #include <list.h>
 #include <string.h>
@@ -8,11 +9,13 @@
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/input.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
+#include "filesys/inode.h"
 #ifdef VM
 #include "filesys/off_t.h"
 #include "userprog/pagedir.h"
@@ -20,6 +23,7 @@
 #include "vm/page.h"
 #endif
 #ifdef FILESYS
+#include "filesys/cache.h"
 #include "filesys/directory.h"
 #endif
 
@@ -41,9 +45,20 @@ static int sys_write (int fd, const void *buffer, unsigned size);
 static void sys_seek (int fd, unsigned position);
 static unsigned sys_tell (int fd);
 static void sys_close (int fd);
+static int sys_pread (int fd, void *buffer, unsigned size, unsigned position);
+static int sys_pwrite (int fd, const void *buffer, unsigned size,
+                       unsigned position);
+static int sys_readv (int fd, const struct iovec *iov, int cnt);
+static int sys_writev (int fd, const struct iovec *iov, int cnt);
+static int sys_copy_file_range (int fd_in, int fd_out, unsigned size);
+static int sys_ring_enter (struct io_ring *ring);
 #ifdef VM
 static mapid_t sys_mmap (int fd, void *addr);
 static void sys_munmap (mapid_t mapid);
+static void *sys_sbrk (intptr_t increment);
+static pid_t sys_fork (void);
+static mapid_t sys_mmap_range (void *addr, size_t length, int flags, int fd,
+                               unsigned offset);
 #endif
 #ifdef FILESYS
 static bool sys_chdir (const char *dir);
@@ -51,180 +66,381 @@ static bool sys_mkdir (const char *dir);
 static bool sys_readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 static bool sys_isdir (int fd);
 static int sys_inumber (int fd);
+static bool sys_fsync (int fd);
+static int sys_getdents (int fd, struct dirent *ents, unsigned cnt);
 #endif
 
+static bool is_user_range (const void *buffer, size_t size);
 static struct file *thread_fd_get (int fd);
 static void thread_fd_free (int fd);
 static int thread_fd_insert (struct file *file);
 
-static struct lock filesys_lock;
+/* Handlers for the system call table.  Each unpacks the
+   arguments fetched from the user stack and calls the matching
+   sys_*() function. */
+static uint32_t
+call_halt (const uint32_t *args UNUSED)
+{
+  sys_halt ();
+  NOT_REACHED ();
+}
+
+static uint32_t
+call_exit (const uint32_t *args)
+{
+  sys_exit ((int) args[0]);
+  NOT_REACHED ();
+}
+
+static uint32_t
+call_exec (const uint32_t *args)
+{
+  return sys_exec ((const char *) args[0]);
+}
+
+static uint32_t
+call_wait (const uint32_t *args)
+{
+  return sys_wait ((pid_t) args[0]);
+}
+
+static uint32_t
+call_create (const uint32_t *args)
+{
+  return sys_create ((const char *) args[0], args[1]);
+}
+
+static uint32_t
+call_remove (const uint32_t *args)
+{
+  return sys_remove ((const char *) args[0]);
+}
+
+static uint32_t
+call_open (const uint32_t *args)
+{
+  return sys_open ((const char *) args[0]);
+}
+
+static uint32_t
+call_filesize (const uint32_t *args)
+{
+  return sys_filesize ((int) args[0]);
+}
+
+static uint32_t
+call_read (const uint32_t *args)
+{
+  return sys_read ((int) args[0], (void *) args[1], args[2]);
+}
+
+static uint32_t
+call_write (const uint32_t *args)
+{
+  return sys_write ((int) args[0], (const void *) args[1], args[2]);
+}
+
+static uint32_t
+call_seek (const uint32_t *args)
+{
+  sys_seek ((int) args[0], args[1]);
+  return 0;
+}
+
+static uint32_t
+call_tell (const uint32_t *args)
+{
+  return sys_tell ((int) args[0]);
+}
+
+static uint32_t
+call_close (const uint32_t *args)
+{
+  sys_close ((int) args[0]);
+  return 0;
+}
+
+static uint32_t
+call_pread (const uint32_t *args)
+{
+  return sys_pread ((int) args[0], (void *) args[1], args[2], args[3]);
+}
+
+static uint32_t
+call_pwrite (const uint32_t *args)
+{
+  return sys_pwrite ((int) args[0], (const void *) args[1], args[2], args[3]);
+}
+
+static uint32_t
+call_readv (const uint32_t *args)
+{
+  return sys_readv ((int) args[0], (const struct iovec *) args[1],
+                    (int) args[2]);
+}
+
+static uint32_t
+call_writev (const uint32_t *args)
+{
+  return sys_writev ((int) args[0], (const struct iovec *) args[1],
+                     (int) args[2]);
+}
+
+static uint32_t
+call_copy_file_range (const uint32_t *args)
+{
+  return sys_copy_file_range ((int) args[0], (int) args[1], args[2]);
+}
+
+static uint32_t
+call_ring_enter (const uint32_t *args)
+{
+  return sys_ring_enter ((struct io_ring *) args[0]);
+}
+
+#ifdef VM
+static uint32_t
+call_mmap (const uint32_t *args)
+{
+  return sys_mmap ((int) args[0], (void *) args[1]);
+}
+
+static uint32_t
+call_munmap (const uint32_t *args)
+{
+  sys_munmap ((mapid_t) args[0]);
+  return 0;
+}
+
+static uint32_t
+call_mmap_range (const uint32_t *args)
+{
+  return sys_mmap_range ((void *) args[0], args[1], (int) args[2],
+                         (int) args[3], args[4]);
+}
+
+static uint32_t
+call_sbrk (const uint32_t *args)
+{
+  return (uint32_t) sys_sbrk ((intptr_t) args[0]);
+}
+
+static uint32_t
+call_fork (const uint32_t *args UNUSED)
+{
+  return sys_fork ();
+}
+#endif
+
+#ifdef FILESYS
+static uint32_t
+call_chdir (const uint32_t *args)
+{
+  return sys_chdir ((const char *) args[0]);
+}
+
+static uint32_t
+call_mkdir (const uint32_t *args)
+{
+  return sys_mkdir ((const char *) args[0]);
+}
+
+static uint32_t
+call_readdir (const uint32_t *args)
+{
+  return sys_readdir ((int) args[0], (char *) args[1]);
+}
+
+static uint32_t
+call_isdir (const uint32_t *args)
+{
+  return sys_isdir ((int) args[0]);
+}
+
+static uint32_t
+call_inumber (const uint32_t *args)
+{
+  return sys_inumber ((int) args[0]);
+}
+
+static uint32_t
+call_fsync (const uint32_t *args)
+{
+  return sys_fsync ((int) args[0]);
+}
+
+static uint32_t
+call_getdents (const uint32_t *args)
+{
+  return sys_getdents ((int) args[0], (struct dirent *) args[1], args[2]);
+}
+#endif
+
+/* Most arguments any system call takes. */
+#define SYSCALL_ARG_MAX 5
+
+/* A system call. */
+struct syscall
+  {
+    const char *name;                   /* Name, for statistics. */
+    int arg_cnt;                        /* Number of arguments. */
+    uint32_t (*handler) (const uint32_t *args);     /* Handler. */
+    bool ring;                          /* May be queued to ring_enter()? */
+  };
+
+/* System calls, indexed by number.  Numbers without a handler,
+   such as those of subsystems not built in, are invalid. */
+static const struct syscall syscalls[] =
+  {
+    [SYS_HALT] = {"halt", 0, call_halt},
+    [SYS_EXIT] = {"exit", 1, call_exit},
+    [SYS_EXEC] = {"exec", 1, call_exec},
+    [SYS_WAIT] = {"wait", 1, call_wait},
+    [SYS_CREATE] = {"create", 2, call_create, true},
+    [SYS_REMOVE] = {"remove", 1, call_remove, true},
+    [SYS_OPEN] = {"open", 1, call_open, true},
+    [SYS_FILESIZE] = {"filesize", 1, call_filesize, true},
+    [SYS_READ] = {"read", 3, call_read, true},
+    [SYS_WRITE] = {"write", 3, call_write, true},
+    [SYS_SEEK] = {"seek", 2, call_seek, true},
+    [SYS_TELL] = {"tell", 1, call_tell, true},
+    [SYS_CLOSE] = {"close", 1, call_close, true},
+    [SYS_PREAD] = {"pread", 4, call_pread, true},
+    [SYS_PWRITE] = {"pwrite", 4, call_pwrite, true},
+    [SYS_READV] = {"readv", 3, call_readv, true},
+    [SYS_WRITEV] = {"writev", 3, call_writev, true},
+    [SYS_COPY_FILE_RANGE] = {"copy_file_range", 3, call_copy_file_range,
+                             true},
+    [SYS_RING_ENTER] = {"ring_enter", 1, call_ring_enter},
+#ifdef VM
+    [SYS_MMAP] = {"mmap", 2, call_mmap},
+    [SYS_MUNMAP] = {"munmap", 1, call_munmap},
+    [SYS_MMAP_RANGE] = {"mmap_range", 5, call_mmap_range},
+    [SYS_SBRK] = {"sbrk", 1, call_sbrk},
+    [SYS_FORK] = {"fork", 0, call_fork},
+#endif
+#ifdef FILESYS
+    [SYS_CHDIR] = {"chdir", 1, call_chdir},
+    [SYS_MKDIR] = {"mkdir", 1, call_mkdir},
+    [SYS_READDIR] = {"readdir", 2, call_readdir},
+    [SYS_ISDIR] = {"isdir", 1, call_isdir},
+    [SYS_INUMBER] = {"inumber", 1, call_inumber},
+    [SYS_FSYNC] = {"fsync", 1, call_fsync, true},
+    [SYS_GETDENTS] = {"getdents", 3, call_getdents},
+#endif
+  };
+
+/* Number of entries in syscalls[]. */
+#define SYSCALL_CNT (sizeof syscalls / sizeof *syscalls)
+
+/* Number of buckets in a latency histogram.  Bucket I counts
+   calls that took from 2**I to 2**(I+1) - 1 cycles. */
+#define SYSCALL_HIST_CNT 32
+
+/* Statistics for one system call. */
+struct syscall_stats
+  {
+    long long call_cnt;                 /* Number of calls. */
+    long long error_cnt;                /* Calls that returned -1. */
+    long long cycles;                   /* Total cycles in handler. */
+    unsigned hist[SYSCALL_HIST_CNT];    /* Latency histogram. */
+  };
+
+static struct syscall_stats syscall_stats[SYSCALL_CNT];
+
+/* Returns the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
 
 void
 syscall_init (void)
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
-  lock_init (&filesys_lock);
+}
+
+/* Runs system call SYSCALL_NR, which must be valid, with the
+   given ARGS, and returns its result.  Updates its statistics. */
+static uint32_t
+syscall_invoke (int syscall_nr, const uint32_t *args)
+{
+  struct syscall_stats *st = &syscall_stats[syscall_nr];
+  enum intr_level old_level;
+  uint64_t start, cycles;
+  uint32_t result;
+  int bucket;
+
+  old_level = intr_disable ();
+  st->call_cnt++;
+  intr_set_level (old_level);
+
+  start = rdtsc ();
+  result = syscalls[syscall_nr].handler (args);
+  cycles = rdtsc () - start;
+
+  for (bucket = 0; cycles >> (bucket + 1) != 0
+                   && bucket < SYSCALL_HIST_CNT - 1; bucket++)
+    continue;
+  old_level = intr_disable ();
+  if ((int) result == -1)
+    st->error_cnt++;
+  st->cycles += cycles;
+  st->hist[bucket]++;
+  intr_set_level (old_level);
+
+  return result;
 }
 
 static void
 syscall_handler (struct intr_frame *f)
 {
+  const struct syscall *sc;
+  uint32_t args[SYSCALL_ARG_MAX];
   int syscall_nr;
-  void *arg1 = (int *) f->esp + 1;
-  void *arg2 = (int *) f->esp + 2;
-  void *arg3 = (int *) f->esp + 3;
-  int status;
-  const char *file;
-  pid_t pid;
-  unsigned initial_size, size, position;
-  int fd;
-  void *rbuffer;
-  const void *wbuffer;
-#ifdef VM
-  void *addr;
-  mapid_t mapid;
-#endif
-#ifdef FILESYS
-  char *dir;
-  char *name;
-#endif
 
   if (!is_user_vaddr ((int *) f->esp))
     sys_exit (-1);
   thread_current ()->esp = f->esp;
   syscall_nr = *(int *) f->esp;
 
-  switch (syscall_nr)
+  if (syscall_nr < 0 || (size_t) syscall_nr >= SYSCALL_CNT
+      || syscalls[syscall_nr].handler == NULL)
+    sys_exit (-1);
+  sc = &syscalls[syscall_nr];
+
+  /* Fetch every argument at once.  They sit just above the call
+     number, so checking the last one covers all of them. */
+  if (!is_user_vaddr ((uint32_t *) f->esp + sc->arg_cnt))
+    sys_exit (-1);
+  memcpy (args, (uint32_t *) f->esp + 1, sc->arg_cnt * sizeof *args);
+
+  f->eax = syscall_invoke (syscall_nr, args);
+}
+
+/* Prints statistics for each system call that was made. */
+void
+syscall_print_stats (void)
+{
+  size_t i;
+  int b;
+
+  for (i = 0; i < SYSCALL_CNT; i++)
     {
-    case SYS_HALT:
-      sys_halt ();
-      break;
-    case SYS_EXIT:
-      if (!is_user_vaddr (arg1))
-        sys_exit (-1);
-      status = *(int *) arg1;
-      sys_exit (status);
-      break;
-    case SYS_EXEC:
-      if (!is_user_vaddr (arg1))
-        sys_exit (-1);
-      file = *(char **) arg1;
-      f->eax = sys_exec (file);
-      break;
-    case SYS_WAIT:
-      if (!is_user_vaddr (arg1))
-        sys_exit (-1);
-      pid = *(pid_t *) arg1;
-      f->eax = sys_wait (pid);
-      break;
-    case SYS_CREATE:
-      if (!is_user_vaddr (arg2))
-        sys_exit (-1);
-      file = *(char **) arg1;
-      initial_size = *(unsigned *) arg2;
-      f->eax = sys_create (file, initial_size);
-      break;
-    case SYS_REMOVE:
-      if (!is_user_vaddr (arg1))
-        sys_exit (-1);
-      file = *(char **) arg1;
-      f->eax = sys_remove (file);
-      break;
-    case SYS_OPEN:
-      if (!is_user_vaddr (arg1))
-        sys_exit (-1);
-      file = *(char **) arg1;
-      f->eax = sys_open (file);
-      break;
-    case SYS_FILESIZE:
-      if (!is_user_vaddr (arg1))
-        sys_exit (-1);
-      fd = *(int *) arg1;
-      f->eax = sys_filesize (fd);
-      break;
-    case SYS_READ:
-      if (!is_user_vaddr (arg3))
-        sys_exit (-1);
-      fd = *(int *) arg1;
-      rbuffer = *(void **) arg2;
-      size = *(unsigned *) arg3;
-      f->eax = sys_read (fd, rbuffer, size);
-      break;
-    case SYS_WRITE:
-      if (!is_user_vaddr (arg3))
-        sys_exit (-1);
-      fd = *(int *) arg1;
-      wbuffer = *(void **) arg2;
-      size = *(unsigned *) arg3;
-      f->eax = sys_write (fd, wbuffer, size);
-      break;
-    case SYS_SEEK:
-      if (!is_user_vaddr (arg2))
-        sys_exit (-1);
-      fd = *(int *) arg1;
-      position = *(unsigned *) arg2;
-      sys_seek (fd, position);
-      break;
-    case SYS_TELL:
-      if (!is_user_vaddr (arg1))
-        sys_exit (-1);
-      fd = *(int *) arg1;
-      f->eax = sys_tell (fd);
-      break;
-    case SYS_CLOSE:
-      if (!is_user_vaddr (arg1))
-        sys_exit (-1);
-      fd = *(int *) arg1;
-      sys_close (fd);
-      break;
-#ifdef VM
-    case SYS_MMAP:
-      if (!is_user_vaddr (arg2))
-        sys_exit (-1);
-      fd = *(int *) arg1;
-      addr = *(void **) arg2;
-      f->eax = sys_mmap (fd, addr);
-      break;
-    case SYS_MUNMAP:
-      if (!is_user_vaddr (arg1))
-        sys_exit (-1);
-      mapid = *(mapid_t *) arg1;
-      sys_munmap (mapid);
-      break;
-#endif
-#ifdef FILESYS
-    case SYS_CHDIR:
-      if (!is_user_vaddr (arg1))
-        sys_exit (-1);
-      dir = *(char **) arg1;
-      f->eax = sys_chdir (dir);
-      break;
-    case SYS_MKDIR:
-      if (!is_user_vaddr (arg1))
-        sys_exit (-1);
-      dir = *(char **) arg1;
-      f->eax = sys_mkdir (dir);
-      break;
-    case SYS_READDIR:
-      if (!is_user_vaddr (arg2))
-        sys_exit (-1);
-      fd = *(int *) arg1;
-      name = *(char **) arg2;
-      f->eax = sys_readdir (fd, name);
-      break;
-    case SYS_ISDIR:
-      if (!is_user_vaddr (arg1))
-        sys_exit (-1);
-      fd = *(int *) arg1;
-      f->eax = sys_isdir (fd);
-      break;
-    case SYS_INUMBER:
-      if (!is_user_vaddr (arg1))
-        sys_exit (-1);
-      fd = *(int *) arg1;
-      f->eax = sys_inumber (fd);
-      break;
-#endif
+      const struct syscall_stats *st = &syscall_stats[i];
+
+      if (st->call_cnt == 0)
+        continue;
+      printf ("Syscall %s: %lld calls, %lld errors, %lld cycles\n",
+              syscalls[i].name, st->call_cnt, st->error_cnt, st->cycles);
+      printf ("  cycles:");
+      for (b = 0; b < SYSCALL_HIST_CNT; b++)
+        if (st->hist[b] != 0)
+          printf (" 2^%d:%u", b, st->hist[b]);
+      printf ("\n");
     }
 }
 
@@ -345,6 +561,8 @@ sys_open (const char *file)
       return -1;
     }
   fd = thread_fd_insert (f);
+  if (fd == -1)
+    file_close (f);
   filesys_release ();
   return fd;
 }
@@ -373,26 +591,17 @@ static int
 sys_read (int fd, void *buffer, unsigned size)
 {
   struct file *file;
-  unsigned i;
   int bytes;
 
 #if PRINT_DEBUG
   printf ("SYS_READ: fd: %d, buffer: %p, size: %u\n", fd, buffer, size);
 #endif
 
-  if (!is_user_vaddr (buffer))
+  if (!is_user_range (buffer, size))
     sys_exit (-1);
 
   if (fd == 0)
-    {
-      for (i = 0; i < size; i++)
-        {
-          *((uint8_t *) buffer + i) = input_getc ();
-          if (*((uint8_t *) buffer + i) == 0)
-            break;
-        }
-      return i;
-    }
+    return input_read_line (buffer, size);
 
   file = thread_fd_get (fd);
   if (file == NULL)
@@ -404,6 +613,35 @@ sys_read (int fd, void *buffer, unsigned size)
   return bytes;
 }
 
+/* Writes the SIZE bytes in user BUFFER to the console.  The data
+   is copied into a kernel page a page at a time and each page is
+   passed to putbuf() in one piece, so that the console layer
+   never faults on user memory and can batch its device writes.
+   If no page is free, a small buffer on the stack is used
+   instead.  Returns SIZE. */
+static int
+console_write (const void *buffer, unsigned size)
+{
+  const uint8_t *src = buffer;
+  unsigned left, chunk, buf_size;
+  char small[128];
+  char *page, *buf;
+
+  page = palloc_get_page (0);
+  buf = page != NULL ? page : small;
+  buf_size = page != NULL ? PGSIZE : sizeof small;
+
+  for (left = size; left > 0; left -= chunk, src += chunk)
+    {
+      chunk = left < buf_size ? left : buf_size;
+      memcpy (buf, src, chunk);
+      putbuf (buf, chunk);
+    }
+
+  palloc_free_page (page);
+  return size;
+}
+
 static int
 sys_write (int fd, const void *buffer, unsigned size)
 {
@@ -418,10 +656,7 @@ sys_write (int fd, const void *buffer, unsigned size)
     sys_exit (-1);
 
   if (fd == 1)
-    {
-      putbuf (buffer, size);
-      return size;
-    }
+    return console_write (buffer, size);
 
   file = thread_fd_get (fd);
   if (file == NULL)
@@ -490,121 +725,558 @@ sys_close (int fd)
   filesys_release ();
 }
 
-#ifdef VM
-static mapid_t
-sys_mmap (int fd, void *addr)
+/* Reads SIZE bytes from FD at byte offset POSITION into BUFFER,
+   leaving the file position unchanged. */
+static int
+sys_pread (int fd, void *buffer, unsigned size, unsigned position)
 {
-  struct thread *curr = thread_current ();
-  struct page *page;
   struct file *file;
-  off_t read_bytes, current_read_bytes;
-  off_t current_ofs = 0;
-  mapid_t mapid;
+  int bytes;
+
+#if PRINT_DEBUG
+  printf ("SYS_PREAD: fd: %d, buffer: %p, size: %u, position: %u\n",
+          fd, buffer, size, position);
+#endif
+
+  if (!is_user_range (buffer, size))
+    sys_exit (-1);
 
-  /* File descriptors 0 and 1 are not mappable. */
   file = thread_fd_get (fd);
   if (file == NULL)
-    return MAP_FAILED;
+    sys_exit (-1);
+  if ((off_t) position < 0)
+    return -1;
 
-  /* ADDR should be page-aligned.
-     Virtual page 0 is not mapped. */
-  if (pg_ofs (addr) != 0 || addr == 0)
-    return MAP_FAILED;
+  filesys_acquire ();
+  bytes = file_read_at (file, buffer, size, position);
+  filesys_release ();
+  return bytes;
+}
+
+/* Writes SIZE bytes from BUFFER to FD at byte offset POSITION,
+   leaving the file position unchanged. */
+static int
+sys_pwrite (int fd, const void *buffer, unsigned size, unsigned position)
+{
+  struct file *file;
+  int bytes;
+
+#if PRINT_DEBUG
+  printf ("SYS_PWRITE: fd: %d, buffer: %p, size: %u, position: %u\n",
+          fd, buffer, size, position);
+#endif
+
+  if (!is_user_range (buffer, size))
+    sys_exit (-1);
+
+  file = thread_fd_get (fd);
+  if (file == NULL)
+    sys_exit (-1);
+  if ((off_t) position < 0)
+    return -1;
 
-  /* File should have positive length. */
   filesys_acquire ();
-  read_bytes = file_length (file);
+  bytes = file_write_at (file, buffer, size, position);
   filesys_release ();
-  if (read_bytes == 0)
-    return MAP_FAILED;
-  current_read_bytes = read_bytes;
+  return bytes;
+}
+
+/* Copies the CNT iovecs at user address IOV into a new kernel
+   array, so that they are fetched and checked only once.  Exits
+   the process if IOV or any of its buffers is not in user
+   memory.  Returns a null pointer if memory allocation fails or
+   if the buffers total more than INT_MAX bytes, which could not
+   be returned. */
+static struct iovec *
+iov_fetch (const struct iovec *iov, int cnt)
+{
+  struct iovec *kiov;
+  size_t total = 0;
+  int i;
+
+  if (cnt < 0 || cnt > IOV_MAX
+      || !is_user_range (iov, cnt * sizeof *iov))
+    sys_exit (-1);
+
+  kiov = malloc (cnt * sizeof *kiov);
+  if (kiov == NULL)
+    return NULL;
+  memcpy (kiov, iov, cnt * sizeof *kiov);
+
+  for (i = 0; i < cnt; i++)
+    {
+      if (!is_user_range (kiov[i].iov_base, kiov[i].iov_len))
+        {
+          free (kiov);
+          sys_exit (-1);
+        }
+      if (kiov[i].iov_len > INT_MAX - total)
+        {
+          free (kiov);
+          return NULL;
+        }
+      total += kiov[i].iov_len;
+    }
+  return kiov;
+}
+
+/* Reads from FD into the CNT buffers described by IOV, in order,
+   under a single acquisition of FILESYS_LOCK.  Returns the number
+   of bytes read, which is short only at end of file. */
+static int
+sys_readv (int fd, const struct iovec *iov, int cnt)
+{
+  struct iovec *kiov;
+  struct file *file = NULL;
+  int bytes = 0, n, i;
+
+#if PRINT_DEBUG
+  printf ("SYS_READV: fd: %d, iov: %p, cnt: %d\n", fd, iov, cnt);
+#endif
+
+  if (cnt == 0)
+    return 0;
+  kiov = iov_fetch (iov, cnt);
+  if (kiov == NULL)
+    return -1;
+
+  if (fd != 0)
+    {
+      file = thread_fd_get (fd);
+      if (file == NULL)
+        {
+          free (kiov);
+          sys_exit (-1);
+        }
+      filesys_acquire ();
+    }
+  for (i = 0; i < cnt; i++)
+    {
+      if (fd == 0)
+        n = sys_read (0, kiov[i].iov_base, kiov[i].iov_len);
+      else
+        n = file_read (file, kiov[i].iov_base, kiov[i].iov_len);
+      bytes += n;
+      if (n < (int) kiov[i].iov_len)
+        break;
+    }
+  if (fd != 0)
+    filesys_release ();
+
+  free (kiov);
+  return bytes;
+}
+
+/* Writes the CNT buffers described by IOV to FD, in order, under
+   a single acquisition of FILESYS_LOCK.  Console output of up to
+   a page is gathered and written with a single putbuf(), so that
+   it is not interleaved with other output; longer output goes
+   through console_write() one buffer at a time.  Returns the
+   number of bytes written. */
+static int
+sys_writev (int fd, const struct iovec *iov, int cnt)
+{
+  struct iovec *kiov;
+  struct file *file;
+  uint8_t *buf;
+  int bytes = 0, n, i;
+
+#if PRINT_DEBUG
+  printf ("SYS_WRITEV: fd: %d, iov: %p, cnt: %d\n", fd, iov, cnt);
+#endif
+
+  if (cnt == 0)
+    return 0;
+  kiov = iov_fetch (iov, cnt);
+  if (kiov == NULL)
+    return -1;
+
+  if (fd == 1)
+    {
+      for (i = 0; i < cnt; i++)
+        bytes += kiov[i].iov_len;
+      buf = bytes <= PGSIZE ? malloc (bytes) : NULL;
+      if (buf != NULL)
+        {
+          for (i = n = 0; i < cnt; n += kiov[i++].iov_len)
+            memcpy (buf + n, kiov[i].iov_base, kiov[i].iov_len);
+          putbuf ((char *) buf, bytes);
+          free (buf);
+        }
+      else
+        for (i = 0; i < cnt; i++)
+          console_write (kiov[i].iov_base, kiov[i].iov_len);
+      free (kiov);
+      return bytes;
+    }
+
+  file = thread_fd_get (fd);
+  if (file == NULL)
+    {
+      free (kiov);
+      sys_exit (-1);
+    }
+
+  filesys_acquire ();
+  for (i = 0; i < cnt; i++)
+    {
+      n = file_write (file, kiov[i].iov_base, kiov[i].iov_len);
+      bytes += n;
+      if (n < (int) kiov[i].iov_len)
+        break;
+    }
+  filesys_release ();
+
+  free (kiov);
+  return bytes;
+}
+
+/* Copies up to SIZE bytes from FD_IN to FD_OUT, starting at and
+   advancing each file's position.  The data moves through a
+   kernel page one chunk at a time and never passes through user
+   memory.  Returns the number of bytes copied, which is short
+   only at end of FD_IN or if FD_OUT cannot grow, or -1 if either
+   file is a directory or memory allocation fails. */
+static int
+sys_copy_file_range (int fd_in, int fd_out, unsigned size)
+{
+  struct file *in, *out;
+  void *buf;
+  int bytes = 0;
+  off_t chunk, n, w;
+  bool is_dir;
+
+#if PRINT_DEBUG
+  printf ("SYS_COPY_FILE_RANGE: fd_in: %d, fd_out: %d, size: %u\n",
+          fd_in, fd_out, size);
+#endif
+
+  in = thread_fd_get (fd_in);
+  out = thread_fd_get (fd_out);
+  if (in == NULL || out == NULL)
+    sys_exit (-1);
+
+  filesys_acquire ();
+  is_dir = (inode_is_dir (file_get_inode (in))
+            || inode_is_dir (file_get_inode (out)));
+  filesys_release ();
+  if (is_dir)
+    return -1;
+
+  buf = palloc_get_page (0);
+  if (buf == NULL)
+    return -1;
+
+  /* FILESYS_LOCK is dropped between chunks so that a long copy
+     does not hold off other file system calls. */
+  while (size > 0)
+    {
+      chunk = size < PGSIZE ? size : PGSIZE;
+      filesys_acquire ();
+      n = file_read (in, buf, chunk);
+      w = n > 0 ? file_write (out, buf, n) : 0;
+      if (w < 0)
+        w = 0;
+      if (w < n)
+        file_seek (in, file_tell (in) - (n - w));
+      filesys_release ();
+
+      bytes += w;
+      size -= w;
+      if (w < chunk)
+        break;
+    }
+
+  palloc_free_page (buf);
+  return bytes;
+}
+
+/* Runs the system calls queued in RING's submission queue, in
+   order, posting each result to its completion queue.  Stops
+   early if the completion queue fills.  Only calls marked in
+   syscalls[] may be queued; any other opcode completes with -1.
+   Returns the number of entries consumed, or -1 if the ring's
+   indexes are inconsistent. */
+static int
+sys_ring_enter (struct io_ring *ring)
+{
+  unsigned sq_head, sq_tail, cq_tail;
+  int cnt = 0;
+
+#if PRINT_DEBUG
+  printf ("SYS_RING_ENTER: ring: %p\n", ring);
+#endif
+
+  if (!is_user_vaddr (ring) || !is_user_vaddr (ring + 1))
+    sys_exit (-1);
+
+  sq_head = ring->sq_head;
+  sq_tail = ring->sq_tail;
+  cq_tail = ring->cq_tail;
+  if (sq_tail - sq_head > IO_RING_ENTRIES
+      || cq_tail - ring->cq_head > IO_RING_ENTRIES)
+    return -1;
+
+  while (sq_head != sq_tail
+         && cq_tail - ring->cq_head < IO_RING_ENTRIES)
+    {
+      /* Copy the entry first, so that the process cannot change
+         it between checking and use. */
+      struct io_sqe sqe = ring->sq[sq_head % IO_RING_ENTRIES];
+      struct io_cqe *cqe = &ring->cq[cq_tail % IO_RING_ENTRIES];
+      int result = -1;
+
+      if (sqe.opcode >= 0 && (size_t) sqe.opcode < SYSCALL_CNT
+          && syscalls[sqe.opcode].ring)
+        result = syscall_invoke (sqe.opcode, sqe.args);
+
+      cqe->result = result;
+      cqe->user_data = sqe.user_data;
+      ring->sq_head = ++sq_head;
+      ring->cq_tail = ++cq_tail;
+      cnt++;
+    }
+  return cnt;
+}
+
+#ifdef VM
+/* Creates a mapping of LENGTH bytes at ADDR, which must be
+   page-aligned.  If FILE is nonnull, the pages hold its contents
+   starting at OFFSET, with zeros past FILE_SIZE, and
+   WRITE_BACK says whether modified pages are written back to
+   it.  Otherwise the pages are zero-filled.  Nothing is read
+   until a page is touched.  Returns the new mapping's
+   identifier, or MAP_FAILED if the range overlaps any page
+   already in use. */
+static mapid_t
+mmap_pages (void *addr, size_t length, struct file *file, off_t offset,
+            off_t file_size, bool write_back)
+{
+  struct thread *curr = thread_current ();
+  struct page *page;
+  uint8_t *upage;
+  off_t left;
+  size_t ofs;
+  mapid_t mapid;
 
   frame_acquire ();
   mapid = curr->max_mapid++;
-  while (current_read_bytes > 0)
+  for (ofs = 0; ofs < length; ofs += PGSIZE)
     {
-      if (page_insert ((uint8_t *) addr + current_ofs) != NULL)
+      upage = (uint8_t *) addr + ofs;
+      if (page_insert (upage) != NULL)
         {
-          curr->max_mapid--;
-          while (current_ofs > 0)
+          /* Undo this mapping's pages, which are at the end of
+             the list. */
+          while (!list_empty (&curr->mmap_list))
             {
-              current_ofs -= PGSIZE;
-              page = list_entry (list_pop_back (&curr->mmap_list),
+              page = list_entry (list_back (&curr->mmap_list),
                                  struct page, elem);
-              hash_delete (&curr->page_table, &page->hash_elem);
-              free (page);
+              if (page->mapid != mapid)
+                break;
+              page_remove (&curr->page_table, page);
             }
+          curr->max_mapid--;
           frame_release ();
           return MAP_FAILED;
         }
-      page = page_find (&curr->page_table, (uint8_t *) addr + current_ofs);
+      page = page_find (&curr->page_table, upage);
       page->loaded = false;
       page->mapid = mapid;
-      page->file = file_reopen (file);
-      page->file_ofs = current_ofs;
-      page->file_read_bytes = (current_read_bytes < PGSIZE
-                               ? current_read_bytes : PGSIZE);
-      page->file_writable = true;
+      if (file != NULL)
+        {
+          left = file_size - (offset + (off_t) ofs);
+          filesys_acquire ();
+          page->file = file_reopen (file);
+          filesys_release ();
+          page->file_ofs = offset + ofs;
+          page->file_read_bytes = (left <= 0 ? 0
+                                   : left < PGSIZE ? left : PGSIZE);
+          page->file_writable = true;
+          page->write_back = write_back;
+        }
       list_push_back (&curr->mmap_list, &page->elem);
-
-      current_read_bytes -= page->file_read_bytes;
-      current_ofs += PGSIZE;
     }
   frame_release ();
 
   return mapid;
 }
+
+static mapid_t
+sys_mmap (int fd, void *addr)
+{
+  struct file *file;
+  off_t length;
+
+#if PRINT_DEBUG
+  printf ("SYS_MMAP: fd: %d, addr: %p\n", fd, addr);
 #endif
 
-#ifdef VM
+  /* File descriptors 0 and 1 are not mappable. */
+  file = thread_fd_get (fd);
+  if (file == NULL)
+    return MAP_FAILED;
+
+  /* ADDR should be page-aligned.
+     Virtual page 0 is not mapped. */
+  if (pg_ofs (addr) != 0 || addr == 0)
+    return MAP_FAILED;
+
+  /* File should have positive length. */
+  filesys_acquire ();
+  length = file_length (file);
+  filesys_release ();
+  if (length == 0)
+    return MAP_FAILED;
+
+  return mmap_pages (addr, length, file, 0, length, true);
+}
+
 static void
 sys_munmap (mapid_t mapid)
 {
   struct thread *curr = thread_current ();
   struct list_elem *e;
   struct page *page;
-  void *kpage;
 
+#if PRINT_DEBUG
+  printf ("SYS_MUNMAP: mapid: %d\n", mapid);
+#endif
+
+  /* MMAP_LIST is in order of mapping identifier. */
   frame_acquire ();
-  if (!list_empty (&curr->mmap_list))
+  e = list_begin (&curr->mmap_list);
+  while (e != list_end (&curr->mmap_list))
     {
-      e = list_front (&curr->mmap_list);
-      while (e != list_end (&curr->mmap_list))
-        {
-          page = list_entry (e, struct page, elem);
-          if (page->mapid < mapid)
-            {
-              e = list_next (e);
-              continue;
-            }
-          else if (page->mapid > mapid)
-            break;
+      page = list_entry (e, struct page, elem);
+      if (page->mapid > mapid)
+        break;
+      e = list_next (e);
+      if (page->mapid == mapid)
+        page_remove (&curr->page_table, page);
+    }
+  frame_release ();
+}
 
-          e = list_next (e);
-          list_remove (&page->elem);
-          kpage = pagedir_get_page (curr->pagedir, page->addr);
-          if (kpage == NULL)
-            {
-              hash_delete (&curr->page_table, &page->hash_elem);
-              free (page);
-              continue;
-            }
+/* Maps LENGTH bytes at ADDR, which must be page-aligned.  With
+   MAP_ANONYMOUS in FLAGS the memory is zero-filled; otherwise it
+   holds the contents of FD starting at OFFSET, which must also be
+   page-aligned.  Exactly one of MAP_SHARED, under which changes
+   are written back to the file, and MAP_PRIVATE, under which
+   they are not, must be given.  Returns the mapping identifier
+   or MAP_FAILED. */
+static mapid_t
+sys_mmap_range (void *addr, size_t length, int flags, int fd,
+                unsigned offset)
+{
+  int sharing = flags & (MAP_SHARED | MAP_PRIVATE);
+  struct file *file = NULL;
+  off_t file_size = 0;
+
+#if PRINT_DEBUG
+  printf ("SYS_MMAP_RANGE: addr: %p, length: %zu, flags: %#x, fd: %d, "
+          "offset: %u\n", addr, length, flags, fd, offset);
+#endif
+
+  if (addr == NULL || pg_ofs (addr) != 0 || length == 0
+      || (uintptr_t) addr > (uintptr_t) PHYS_BASE - MAX_STACK_SIZE
+      || length > (uintptr_t) PHYS_BASE - MAX_STACK_SIZE - (uintptr_t) addr
+      || (sharing != MAP_SHARED && sharing != MAP_PRIVATE)
+      || (flags & ~(MAP_SHARED | MAP_PRIVATE | MAP_ANONYMOUS)) != 0
+      || offset % PGSIZE != 0 || (off_t) offset < 0)
+    return MAP_FAILED;
+
+  if ((flags & MAP_ANONYMOUS) == 0)
+    {
+      file = thread_fd_get (fd);
+      if (file == NULL)
+        return MAP_FAILED;
+      filesys_acquire ();
+      file_size = file_length (file);
+      filesys_release ();
+    }
+
+  return mmap_pages (addr, length, file, offset, file_size,
+                     file != NULL && sharing == MAP_SHARED);
+}
+
+/* Moves the program break, the end of the heap, by INCREMENT
+   bytes and returns its old value, or (void *) -1 if the heap
+   cannot be moved there.  New heap pages are zero-filled when
+   first touched; pages given back are freed at once. */
+static void *
+sys_sbrk (intptr_t increment)
+{
+  struct thread *curr = thread_current ();
+  uint8_t *old_brk = curr->heap_brk;
+  uint8_t *new_brk = old_brk + increment;
+  uint8_t *start, *upage;
+  struct page *page;
+
+#if PRINT_DEBUG
+  printf ("SYS_SBRK: increment: %d\n", increment);
+#endif
+
+  /* The heap may not wrap around, shrink below its start, or
+     grow into the area reserved for the stack. */
+  if ((increment < 0 && (new_brk > old_brk || new_brk < curr->heap_start))
+      || (increment > 0
+          && (new_brk < old_brk
+              || new_brk > (uint8_t *) PHYS_BASE - MAX_STACK_SIZE)))
+    return (void *) -1;
 
-          if (pagedir_is_dirty (curr->pagedir, page->addr))
+  frame_acquire ();
+  if (increment > 0)
+    {
+      start = pg_round_up (old_brk);
+      for (upage = start; upage < new_brk; upage += PGSIZE)
+        {
+          /* Fail if a file is mapped in the way. */
+          if (page_insert (upage) != NULL)
             {
-              filesys_acquire ();
-              file_write_at (page->file, page->addr, page->file_read_bytes,
-                             page->file_ofs);
-              filesys_release ();
+              while (upage > start)
+                {
+                  upage -= PGSIZE;
+                  page = page_find (&curr->page_table, upage);
+                  page_remove (&curr->page_table, page);
+                }
+              frame_release ();
+              return (void *) -1;
             }
-
-          pagedir_clear_page (curr->pagedir, page->addr);
-          ASSERT (hash_delete (&curr->page_table, &page->hash_elem) != NULL);
-          free (page);
-          frame_free (kpage);
+          page = page_find (&curr->page_table, upage);
+          page->loaded = false;
         }
     }
+  else
+    for (upage = pg_round_up (new_brk); upage < old_brk; upage += PGSIZE)
+      {
+        page = page_find (&curr->page_table, upage);
+        if (page != NULL)
+          page_remove (&curr->page_table, page);
+      }
+  curr->heap_brk = new_brk;
   frame_release ();
+
+  return old_brk;
+}
+
+/* Creates a copy of the current process, whose memory is shared
+   copy-on-write until either process writes to it.  Returns the
+   child's pid in the parent and 0 in the child, or -1 if the
+   child cannot be created. */
+static pid_t
+sys_fork (void)
+{
+  pid_t pid;
+  struct thread *curr = thread_current ();
+
+#if PRINT_DEBUG
+  printf ("SYS_FORK\n");
+#endif
+
+  pid = process_fork ();
+  sema_down (&curr->load_sema);
+  return curr->child_status == FAILED ? -1 : pid;
 }
 #endif
 
@@ -682,72 +1354,147 @@ sys_inumber (int fd)
 }
 #endif
 
+#ifdef FILESYS
+static bool
+sys_fsync (int fd)
+{
+  struct file *file = thread_fd_get (fd);
+  bool success;
+
+#if PRINT_DEBUG
+  printf ("SYS_FSYNC: fd: %d\n", fd);
+#endif
+
+  if (file == NULL)
+    sys_exit (-1);
+
+  /* Give the file's delayed blocks their sectors, then commit.
+     cache_sync() takes FILESYS_LOCK itself for the commit, after
+     batching concurrent fsync() calls into it. */
+  filesys_acquire ();
+  success = inode_flush (file_get_inode (file));
+  filesys_release ();
+  cache_sync ();
+  return success;
+}
+
+/* Reads up to CNT entries of directory FD into ENTS, with their
+   inode numbers and types, in a single call.  Returns the number
+   of entries read, 0 at the end of the directory, or -1 if FD is
+   not a directory. */
+static int
+sys_getdents (int fd, struct dirent *ents, unsigned cnt)
+{
+  struct file *file = thread_fd_get (fd);
+  struct dirent *kents;
+  struct dir dir;
+  disk_sector_t sector;
+  unsigned i;
+
+#if PRINT_DEBUG
+  printf ("SYS_GETDENTS: fd: %d, ents: %p, cnt: %u\n", fd, ents, cnt);
+#endif
+
+  /* Entries are gathered into a kernel page and copied out after
+     FILESYS_LOCK is released, since touching ENTS may fault. */
+  if (cnt > PGSIZE / sizeof *kents)
+    cnt = PGSIZE / sizeof *kents;
+  if (!is_user_range (ents, cnt * sizeof *ents))
+    sys_exit (-1);
+  if (file == NULL)
+    sys_exit (-1);
+  kents = malloc (cnt * sizeof *kents);
+  if (kents == NULL && cnt > 0)
+    return -1;
+
+  dir.inode = file_get_inode (file);
+  filesys_acquire ();
+  if (!inode_is_dir (dir.inode))
+    {
+      filesys_release ();
+      free (kents);
+      return -1;
+    }
+  dir.pos = file_tell (file);
+  for (i = 0; i < cnt && dir_readdir_sector (&dir, kents[i].name, &sector);
+       i++)
+    {
+      kents[i].inumber = sector;
+      kents[i].is_dir = inode_sector_is_dir (sector);
+    }
+  file_seek (file, dir.pos);
+  filesys_release ();
+
+  memcpy (ents, kents, i * sizeof *kents);
+  free (kents);
+  return i;
+}
+#endif
+
+/* Returns true if the SIZE bytes at BUFFER lie entirely in user
+   memory, without wrapping around. */
+static bool
+is_user_range (const void *buffer, size_t size)
+{
+  const uint8_t *start = buffer;
+  const uint8_t *last = start + size - 1;
+
+  if (size == 0)
+    return is_user_vaddr (start);
+  return last >= start && is_user_vaddr (last);
+}
+
 /* Returns the file pointer with given FD. */
 static struct file *
 thread_fd_get (int fd)
 {
   struct thread *curr = thread_current ();
-  struct thread_fd *tfd;
-  struct list_elem *e;
 
-  if (fd < 2 || fd >= curr->max_fd)
+  if (fd < 2 || fd >= curr->fd_cnt)
     return NULL;
-  for (e = list_begin (&curr->fd_list); e != list_end (&curr->fd_list);
-       e = list_next (e))
-    {
-      tfd = list_entry (e, struct thread_fd, elem);
-      if (tfd->fd == fd)
-        return tfd->file;
-    }
-  return NULL;
+  return curr->fds[fd];
 }
 
-/* Set the file pointer at FD to NULL. */
+/* Frees FD of current thread, making it available for reuse. */
 static void
 thread_fd_free (int fd)
 {
   struct thread *curr = thread_current ();
-  struct thread_fd *tfd;
-  struct list_elem *e;
 
-  for (e = list_begin (&curr->fd_list); e != list_end (&curr->fd_list);
-       e = list_next (e))
-    {
-      tfd = list_entry (e, struct thread_fd, elem);
-      if (tfd->fd == fd)
-        {
-          list_remove (e);
-          free (tfd);
-          break;
-        }
-    }
+  if (fd < 2 || fd >= curr->fd_cnt)
+    return;
+  curr->fds[fd] = NULL;
+  if (fd < curr->fd_next)
+    curr->fd_next = fd;
 }
 
-/* Add FILE to fd_list of current thread and return its fd. */
+/* Add FILE to the fd table of current thread at the lowest free
+   fd, growing the table if it is full, and return the fd.
+   Returns -1 if memory allocation fails. */
 static int
 thread_fd_insert (struct file *file)
 {
   struct thread *curr = thread_current ();
-  struct thread_fd *tfd = (struct thread_fd *)
-    malloc (sizeof (struct thread_fd));
-
-  tfd->fd = curr->max_fd++;
-  tfd->file = file;
-  list_push_back (&curr->fd_list, &tfd->elem);
+  struct file **fds;
+  int fd, cnt;
 
-  return tfd->fd;
-}
+  for (fd = curr->fd_next; fd < curr->fd_cnt; fd++)
+    if (curr->fds[fd] == NULL)
+      break;
 
-/* Acquire the filesys_lock to usage file system. */
-void
-filesys_acquire (void)
-{
-  lock_acquire (&filesys_lock);
-}
+  if (fd >= curr->fd_cnt)
+    {
+      cnt = curr->fd_cnt > 0 ? curr->fd_cnt * 2 : 16;
+      fds = realloc (curr->fds, cnt * sizeof *fds);
+      if (fds == NULL)
+        return -1;
+      memset (fds + curr->fd_cnt, 0, (cnt - curr->fd_cnt) * sizeof *fds);
+      curr->fds = fds;
+      fd = curr->fd_cnt > 2 ? curr->fd_cnt : 2;
+      curr->fd_cnt = cnt;
+    }
 
-/* Release the filesys_lock. */
-void
-filesys_release (void)
-{
-  lock_release (&filesys_lock);
+  curr->fds[fd] = file;
+  curr->fd_next = fd + 1;
+  return fd;
 }
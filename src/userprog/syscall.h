@@ -2,8 +2,7 @@
 #define USERPROG_SYSCALL_H
 
 void syscall_init (void);
+void syscall_print_stats (void);
 void sys_exit (int status);
-void filesys_acquire (void);
-void filesys_release (void);
 
 #endif /* userprog/syscall.h */
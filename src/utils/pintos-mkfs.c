@@ -0,0 +1,372 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/* Builds a formatted Pintos file system disk directly on the
+   host, with the given host files copied into its root
+   directory, so that tests can skip the boot, format and "put"
+   cycle inside the emulator.
+
+   The layouts below must match filesys/ in the kernel: the free
+   map inode in sector 0, the root directory inode in sector 1,
+   the journal header in sector 2 followed by the journal's
+   descriptor and log sectors, sized from the disk as
+   journal_capacity() does,
+   and on-disk inodes, directory entries and the free map bitmap
+   as written by the kernel on an x86 (little-endian) machine. */
+
+#define DISK_SECTOR_SIZE 512
+
+#define FREE_MAP_SECTOR 0
+#define ROOT_DIR_SECTOR 1
+#define JOURNAL_SECTOR 2
+#define JOURNAL_MIN 64
+#define JOURNAL_MAGIC 0x4a524e4c
+
+#define INODE_MAGIC 0x494e4f44
+#define INODE_DIRECT_BLOCKS 12
+#define INODE_INDIRECT_BLOCKS 128
+#define INODE_INLINE_SIZE 436
+
+#define NAME_MAX 14
+#define ROOT_DIR_ENTRIES 16
+#define BLOCK_SECTORS_MAX 8
+
+/* Sectors per cylinder of a disk made by pintos-mkdisk. */
+#define CYLINDER_SECTORS (16 * 63)
+
+/* On-disk inode, as struct inode_disk in filesys/inode.c. */
+struct inode_disk
+  {
+    int32_t length;
+    uint32_t sector_count;
+    uint8_t is_dir;
+    uint8_t is_inline;
+    uint8_t block_sectors;
+    uint8_t pad;
+    uint32_t parent;
+    uint32_t directs[INODE_DIRECT_BLOCKS];
+    uint32_t indirect;
+    uint32_t double_indirect;
+    uint32_t magic;
+    uint8_t inline_data[INODE_INLINE_SIZE];
+  };
+
+/* On-disk directory entry, as struct dir_entry in
+   filesys/directory.c. */
+struct dir_entry
+  {
+    uint32_t inode_sector;
+    char name[NAME_MAX + 1];
+    uint8_t in_use;
+  };
+
+/* On-disk journal header, as in filesys/journal.c. */
+struct journal_header
+  {
+    uint32_t magic;
+    uint32_t cnt;
+    uint8_t unused[DISK_SECTOR_SIZE - 8];
+  };
+
+static const char *program_name;
+
+static uint8_t *disk;                   /* Disk image. */
+static size_t disk_sectors;             /* Sectors in DISK. */
+static uint8_t *free_map;               /* One bit per sector. */
+static size_t free_map_bytes;           /* Size of the free map file. */
+static size_t block_sectors = 1;        /* Sectors per data block. */
+
+static void
+fail (const char *msg, ...)
+     __attribute__ ((noreturn))
+     __attribute__ ((format (printf, 1, 2)));
+
+/* Prints MSG, formatting as with printf(), and exits. */
+static void
+fail (const char *msg, ...)
+{
+  va_list args;
+
+  fprintf (stderr, "%s: ", program_name);
+  va_start (args, msg);
+  vfprintf (stderr, msg, args);
+  va_end (args);
+  putc ('\n', stderr);
+  exit (EXIT_FAILURE);
+}
+
+/* Returns a pointer to sector SECTOR of the image. */
+static void *
+sector_ptr (uint32_t sector)
+{
+  return disk + (size_t) sector * DISK_SECTOR_SIZE;
+}
+
+static bool
+free_map_test (size_t sector)
+{
+  return free_map[sector / 8] & (1u << sector % 8);
+}
+
+static void
+free_map_mark (size_t sector, size_t cnt)
+{
+  for (; cnt > 0; sector++, cnt--)
+    free_map[sector / 8] |= 1u << sector % 8;
+}
+
+/* Allocates CNT consecutive sectors, first fit, and returns the
+   first.  Exits if the disk is full. */
+static uint32_t
+allocate (size_t cnt)
+{
+  size_t start, run;
+
+  for (start = run = 0; start + run < disk_sectors; )
+    if (free_map_test (start + run))
+      {
+        start += run + 1;
+        run = 0;
+      }
+    else if (++run == cnt)
+      {
+        free_map_mark (start, cnt);
+        return start;
+      }
+  fail ("disk full");
+}
+
+/* Returns a pointer to the block map entry for data block IDX of
+   INODE, allocating indirect blocks as needed. */
+static uint32_t *
+block_entry (struct inode_disk *inode, size_t idx)
+{
+  uint32_t *indirect;
+
+  if (idx < INODE_DIRECT_BLOCKS)
+    return &inode->directs[idx];
+  idx -= INODE_DIRECT_BLOCKS;
+
+  if (idx < INODE_INDIRECT_BLOCKS)
+    {
+      if (inode->indirect == 0)
+        inode->indirect = allocate (1);
+      return (uint32_t *) sector_ptr (inode->indirect) + idx;
+    }
+  idx -= INODE_INDIRECT_BLOCKS;
+
+  if (idx < INODE_INDIRECT_BLOCKS * INODE_INDIRECT_BLOCKS)
+    {
+      if (inode->double_indirect == 0)
+        inode->double_indirect = allocate (1);
+      indirect = (uint32_t *) sector_ptr (inode->double_indirect)
+                 + idx / INODE_INDIRECT_BLOCKS;
+      if (*indirect == 0)
+        *indirect = allocate (1);
+      return (uint32_t *) sector_ptr (*indirect)
+             + idx % INODE_INDIRECT_BLOCKS;
+    }
+  fail ("file too large");
+}
+
+/* Copies the LENGTH bytes in DATA into INODE's inline data or
+   its data blocks, which must already be mapped. */
+static void
+write_data (struct inode_disk *inode, const void *data, size_t length)
+{
+  size_t block_size = inode->block_sectors * DISK_SECTOR_SIZE;
+  size_t ofs, chunk;
+
+  if (inode->is_inline)
+    {
+      memcpy (inode->inline_data, data, length);
+      return;
+    }
+
+  for (ofs = 0; ofs < length; ofs += chunk)
+    {
+      chunk = length - ofs < block_size ? length - ofs : block_size;
+      memcpy (sector_ptr (*block_entry (inode, ofs / block_size)),
+              (const uint8_t *) data + ofs, chunk);
+    }
+}
+
+/* Writes an inode at SECTOR holding the LENGTH bytes in DATA.
+   Data that fits is stored inline; otherwise the data blocks are
+   allocated in one contiguous run. */
+static void
+write_inode (uint32_t sector, const void *data, size_t length, bool is_dir)
+{
+  struct inode_disk *inode = sector_ptr (sector);
+  size_t block_size = block_sectors * DISK_SECTOR_SIZE;
+  size_t block_cnt, idx;
+  uint32_t block;
+
+  memset (inode, 0, sizeof *inode);
+  inode->length = length;
+  inode->is_dir = is_dir;
+  inode->is_inline = length <= INODE_INLINE_SIZE;
+  inode->block_sectors = block_sectors;
+  inode->parent = ROOT_DIR_SECTOR;
+  inode->magic = INODE_MAGIC;
+
+  if (!inode->is_inline)
+    {
+      block_cnt = (length + block_size - 1) / block_size;
+      block = allocate (block_cnt * block_sectors);
+      for (idx = 0; idx < block_cnt; idx++, block += block_sectors)
+        {
+          *block_entry (inode, idx) = block;
+          inode->sector_count += block_sectors;
+        }
+    }
+  write_data (inode, data, length);
+}
+
+/* Reads the host file named FILE_NAME into a new buffer and
+   stores its length into *LENGTH. */
+static void *
+read_host_file (const char *file_name, size_t *length)
+{
+  FILE *file;
+  struct stat st;
+  void *data;
+
+  file = fopen (file_name, "rb");
+  if (file == NULL || fstat (fileno (file), &st) < 0)
+    fail ("%s: %s", file_name, strerror (errno));
+  *length = st.st_size;
+  data = malloc (*length + 1);
+  if (data == NULL)
+    fail ("out of memory");
+  if (fread (data, 1, *length, file) != *length)
+    fail ("%s: read error", file_name);
+  fclose (file);
+  return data;
+}
+
+static void
+usage (void)
+{
+  fprintf (stderr,
+           "pintos-mkfs, builds a formatted Pintos file system disk\n"
+           "usage: %s [-b SECTORS] DISKFILE MB [FILE[:NAME]...]\n"
+           "  where DISKFILE is the disk to create,\n"
+           "    MB is its size in (approximate) megabytes, as for\n"
+           "    pintos-mkdisk, and each FILE is copied into the root\n"
+           "    directory as NAME, by default its base name.\n"
+           "  -b SECTORS  Use SECTORS-sector data blocks (default 1),\n"
+           "              as the kernel's -fb option.\n",
+           program_name);
+  exit (EXIT_FAILURE);
+}
+
+int
+main (int argc, char *argv[])
+{
+  struct dir_entry *entries;
+  struct journal_header *journal;
+  size_t journal_capacity;
+  size_t entry_cnt, file_cnt, i;
+  const char *disk_name;
+  double mb;
+  FILE *out;
+
+  program_name = argv[0];
+  if (argc > 2 && !strcmp (argv[1], "-b"))
+    {
+      block_sectors = atoi (argv[2]);
+      if (block_sectors < 1 || block_sectors > BLOCK_SECTORS_MAX)
+        fail ("block size must be 1 to %d sectors", BLOCK_SECTORS_MAX);
+      argc -= 2;
+      argv += 2;
+    }
+  if (argc < 3)
+    usage ();
+
+  disk_name = argv[1];
+  mb = strtod (argv[2], NULL);
+  if (mb <= 0 || mb > 1024)
+    fail ("\"%s\" is not a valid size in megabytes", argv[2]);
+  file_cnt = argc - 3;
+
+  /* Same geometry as pintos-mkdisk. */
+  disk_sectors = (size_t) (mb * 2 + .999999) * CYLINDER_SECTORS;
+  disk = calloc (disk_sectors, DISK_SECTOR_SIZE);
+  free_map_bytes = (disk_sectors + 31) / 32 * 4;
+  free_map = calloc (1, free_map_bytes);
+  entry_cnt = file_cnt > ROOT_DIR_ENTRIES ? file_cnt : ROOT_DIR_ENTRIES;
+  entries = calloc (entry_cnt, sizeof *entries);
+  if (disk == NULL || free_map == NULL || entries == NULL)
+    fail ("out of memory");
+
+  /* System sectors, as free_map_init(). */
+  free_map_mark (FREE_MAP_SECTOR, 1);
+  free_map_mark (ROOT_DIR_SECTOR, 1);
+  journal_capacity = (JOURNAL_MIN + (disk_sectors + 127) / 128
+                      + (disk_sectors + DISK_SECTOR_SIZE * 8 - 1)
+                        / (DISK_SECTOR_SIZE * 8));
+  free_map_mark (JOURNAL_SECTOR,
+                 1 + (journal_capacity + DISK_SECTOR_SIZE / 4 - 1)
+                     / (DISK_SECTOR_SIZE / 4)
+                 + journal_capacity);
+
+  /* Empty journal. */
+  journal = sector_ptr (JOURNAL_SECTOR);
+  journal->magic = JOURNAL_MAGIC;
+  journal->cnt = 0;
+
+  /* Files. */
+  for (i = 0; i < file_cnt; i++)
+    {
+      char *host_name = argv[3 + i];
+      char *name = strrchr (host_name, ':');
+      uint32_t sector;
+      size_t length, j;
+      void *data;
+
+      if (name != NULL)
+        *name++ = '\0';
+      else
+        {
+          name = strrchr (host_name, '/');
+          name = name != NULL ? name + 1 : host_name;
+        }
+      if (*name == '\0' || strlen (name) > NAME_MAX)
+        fail ("%s: invalid Pintos file name", name);
+      for (j = 0; j < i; j++)
+        if (!strcmp (entries[j].name, name))
+          fail ("%s: duplicate file name", name);
+
+      data = read_host_file (host_name, &length);
+      sector = allocate (1);
+      write_inode (sector, data, length, false);
+      free (data);
+
+      entries[i].inode_sector = sector;
+      strcpy (entries[i].name, name);
+      entries[i].in_use = true;
+    }
+
+  /* Root directory, then the free map, which comes last so that
+     it records every allocation.  Its contents are copied again
+     once its own blocks are allocated. */
+  write_inode (ROOT_DIR_SECTOR, entries, entry_cnt * sizeof *entries, true);
+  write_inode (FREE_MAP_SECTOR, free_map, free_map_bytes, false);
+  write_data (sector_ptr (FREE_MAP_SECTOR), free_map, free_map_bytes);
+
+  out = fopen (disk_name, "wb");
+  if (out == NULL)
+    fail ("%s: create: %s", disk_name, strerror (errno));
+  if (fwrite (disk, DISK_SECTOR_SIZE, disk_sectors, out) != disk_sectors
+      || fclose (out) != 0)
+    fail ("%s: write: %s", disk_name, strerror (errno));
+  return EXIT_SUCCESS;
+}
@@ -1,19 +1,41 @@
 #include "vm/frame.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <string.h>
 #include <list.h>
 #include <user/syscall.h>
 #include "filesys/file.h"
+#include "filesys/filesys.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "userprog/syscall.h"
+#include "vm/page.h"
+#include "vm/share.h"
 #include "vm/swap.h"
 
-/* Frame table. */
+/* Frame table.
+
+   FRAME_LOCK protects the frame table and the supplemental page
+   tables, but it is not held during disk I/O.  A frame being read
+   into or written out is pinned, so that it is not evicted, and
+   its page is marked PAGE_LOADING or PAGE_EVICTING.  Threads
+   that need the page to settle wait on FRAME_COND.
+
+   A frame mapped by several pages through a struct share is in
+   the frame table too, with its SHARE member set instead of a
+   thread and user address; vm/share.c tracks the pages mapping
+   it. */
 static struct list frame_table;
 static struct lock frame_lock;
+static struct condition frame_cond;
+
+static void frame_adopt (void *page, void *upage);
+static struct frame *frame_find (void *page);
+static struct frame *frame_choose (void);
+static bool frame_accessed (struct frame *);
 
 /* Initializes the frame table. */
 void
@@ -21,98 +43,254 @@ frame_init (void)
 {
   list_init (&frame_table);
   lock_init (&frame_lock);
+  cond_init (&frame_cond);
 }
 
 /* Allocates a frame. */
 void *
 frame_alloc (void *upage, enum palloc_flags flags)
 {
-  struct frame *frame;
-  void *page = palloc_get_page (PAL_USER | flags);
+  void *page = frame_try_alloc (upage, flags);
 
   if (page == NULL)
-    page = frame_evict (flags);
-
-  if (page != NULL)
     {
-      frame = (struct frame *) malloc (sizeof (struct frame));
-      frame->thread = thread_current ();
-      frame->addr = page;
-      frame->upage = upage;
-      list_push_back (&frame_table, &frame->elem);
+      page = frame_evict (flags);
+      if (page != NULL)
+        frame_adopt (page, upage);
     }
 
   return page;
 }
 
+/* Allocates a frame if one is free, without evicting another.
+   Returns a null pointer if no frame is free. */
+void *
+frame_try_alloc (void *upage, enum palloc_flags flags)
+{
+  void *page = palloc_get_page (PAL_USER | flags);
+
+  if (page != NULL)
+    frame_adopt (page, upage);
+
+  return page;
+}
+
 /* Frees a frame. */
 void
 frame_free (void *page)
 {
-  struct list_elem *e;
+  struct frame *frame = frame_find (page);
+
+  ASSERT (frame != NULL);
+  list_remove (&frame->elem);
+  free (frame);
+  palloc_free_page (page);
+}
+
+/* Adds PAGE, a user pool page mapped at UPAGE in the current
+   process, to the frame table. */
+static void
+frame_adopt (void *page, void *upage)
+{
+  struct frame *frame = (struct frame *) malloc (sizeof (struct frame));
+
+  frame->thread = thread_current ();
+  frame->addr = page;
+  frame->upage = upage;
+  frame->share = NULL;
+  frame->pinned = false;
+  list_push_back (&frame_table, &frame->elem);
+}
+
+/* Marks PAGE as the frame of shared frame S. */
+void
+frame_share (void *page, struct share *s)
+{
+  struct frame *frame = frame_find (page);
+
+  ASSERT (frame != NULL);
+  frame->thread = NULL;
+  frame->upage = NULL;
+  frame->share = s;
+}
+
+/* Marks PAGE, a shared frame, as the private frame of UPAGE in
+   thread T. */
+void
+frame_unshare (void *page, struct thread *t, void *upage)
+{
+  struct frame *frame = frame_find (page);
+
+  ASSERT (frame != NULL && frame->share != NULL);
+  frame->thread = t;
+  frame->upage = upage;
+  frame->share = NULL;
+}
+
+/* Keeps PAGE from being evicted while I/O is done on it. */
+void
+frame_pin (void *page)
+{
+  struct frame *frame = frame_find (page);
+
+  ASSERT (frame != NULL);
+  frame->pinned = true;
+}
+
+/* Lets PAGE be evicted again and wakes up threads waiting for
+   I/O to finish. */
+void
+frame_unpin (void *page)
+{
+  struct frame *frame = frame_find (page);
+
+  ASSERT (frame != NULL);
+  frame->pinned = false;
+  frame_notify ();
+}
+
+/* Evicts a frame and returns it, removed from the frame table,
+   for reuse.  Returns a null pointer if no frame can be evicted.
+   A dirty or copy-on-write frame is written out, and the file of
+   a shared frame closed, without holding the frame table lock, so the caller
+   must not rely on anything the lock protects staying unchanged
+   across this call. */
+void *
+frame_evict (enum palloc_flags flags)
+{
   struct frame *frame;
-  for (e = list_begin (&frame_table); e != list_end (&frame_table);
-       e = list_next (e))
+  struct thread *t;
+  struct page *page;
+  struct share *s;
+  void *kpage;
+  size_t swap_idx = 0;
+  bool dirty;
+
+  frame = frame_choose ();
+  if (frame == NULL)
+    return NULL;
+  frame->pinned = true;
+  kpage = frame->addr;
+
+  if (frame->share != NULL)
     {
-      frame = list_entry (e, struct frame, elem);
-      if (frame->addr == page)
+      s = frame->share;
+      frame->share = NULL;
+      share_evict (s);
+      list_remove (&frame->elem);
+      free (frame);
+      frame_notify ();
+
+      if (flags & PAL_ZERO)
+        memset (kpage, 0, PGSIZE);
+      return kpage;
+    }
+
+  t = frame->thread;
+  page = page_find (&t->page_table, frame->upage);
+  dirty = pagedir_is_dirty (t->pagedir, frame->upage);
+  pagedir_clear_page (t->pagedir, frame->upage);
+
+  if (dirty)
+    {
+      /* Faults on the page wait until it is written out. */
+      page->state = PAGE_EVICTING;
+      frame_release ();
+      if (page->write_back)
         {
-          list_remove (e);
-          palloc_free_page (frame->addr);
-          free (frame);
-          break;
+          filesys_acquire ();
+          file_write_at (page->file, kpage, page->file_read_bytes,
+                         page->file_ofs);
+          filesys_release ();
         }
+      else
+        swap_idx = swap_out (kpage);
+      frame_acquire ();
+      page->state = PAGE_IDLE;
     }
+
+  if (dirty && !page->write_back)
+    {
+      page->valid = false;
+      page->swap_idx = swap_idx;
+    }
+  else
+    page->loaded = false;
+  list_remove (&frame->elem);
+  free (frame);
+  frame_notify ();
+
+  if (flags & PAL_ZERO)
+    memset (kpage, 0, PGSIZE);
+  return kpage;
 }
 
-/* Evicts a frame and return a address of new allocated frame. */
-void *
-frame_evict (enum palloc_flags flags)
+/* Chooses a frame to evict by the second chance algorithm,
+   skipping pinned frames and shared frames that cannot be
+   evicted.  If only pinned frames are left, waits for one to be
+   unpinned.  Returns a null pointer if no frame can be
+   evicted. */
+static struct frame *
+frame_choose (void)
 {
   struct list_elem *e;
-  struct frame *frame = NULL;
-  struct page *page;
+  struct frame *frame;
+  bool pinned;
+  int pass;
 
-  /* Second chance algorithm. */
-  e = list_begin (&frame_table);
-  while (true)
+  for (;;)
     {
-      frame = list_entry (e, struct frame, elem);
-      if (pagedir_is_accessed (frame->thread->pagedir, frame->upage))
-        pagedir_set_accessed (frame->thread->pagedir, frame->upage, false);
-      else
-        {
-          page = page_find (&frame->thread->page_table, frame->upage);
-          if (pagedir_is_dirty (frame->thread->pagedir, frame->upage))
-            {
-              if (page->mapid != MAP_FAILED)
-                {
-                  filesys_acquire ();
-                  file_write_at (page->file, page->addr, page->file_read_bytes,
-                                 page->file_ofs);
-                  filesys_release ();
-                  page->loaded = false;
-                }
-              else
-                {
-                  page->valid = false;
-                  page->swap_idx = swap_out (frame->addr);
-                }
-            }
-          else
-            page->loaded = false;
-          list_remove (e);
-          pagedir_clear_page (frame->thread->pagedir, frame->upage);
-          palloc_free_page (frame->addr);
-          free (frame);
-
-          return palloc_get_page (PAL_USER | flags);
-        }
+      /* The first pass may only clear accessed bits. */
+      pinned = false;
+      for (pass = 0; pass < 2; pass++)
+        for (e = list_begin (&frame_table); e != list_end (&frame_table);
+             e = list_next (e))
+          {
+            frame = list_entry (e, struct frame, elem);
+            if (frame->pinned)
+              pinned = true;
+            else if ((frame->share == NULL || share_evictable (frame->share))
+                     && !frame_accessed (frame))
+              return frame;
+          }
+      if (!pinned)
+        return NULL;
+      frame_wait ();
+    }
+}
+
+/* Returns whether FRAME was accessed since the last call, and
+   clears its accessed bits. */
+static bool
+frame_accessed (struct frame *frame)
+{
+  struct thread *t = frame->thread;
+  bool accessed;
+
+  if (frame->share != NULL)
+    return share_accessed (frame->share);
+
+  accessed = pagedir_is_accessed (t->pagedir, frame->upage);
+  pagedir_set_accessed (t->pagedir, frame->upage, false);
+  return accessed;
+}
+
+/* Returns the frame table entry for PAGE, or a null pointer if
+   PAGE is not in the frame table. */
+static struct frame *
+frame_find (void *page)
+{
+  struct list_elem *e;
+  struct frame *frame;
 
-      e = list_next (e);
-      if (e == list_end (&frame_table))
-        e = list_begin (&frame_table);
+  for (e = list_begin (&frame_table); e != list_end (&frame_table);
+       e = list_next (e))
+    {
+      frame = list_entry (e, struct frame, elem);
+      if (frame->addr == page)
+        return frame;
     }
+  return NULL;
 }
 
 void
@@ -126,3 +304,19 @@ frame_release (void)
 {
   lock_release (&frame_lock);
 }
+
+/* Waits for I/O on some frame or page to finish.  The frame
+   table lock must be held; it is released while waiting. */
+void
+frame_wait (void)
+{
+  cond_wait (&frame_cond, &frame_lock);
+}
+
+/* Wakes up all threads waiting in frame_wait().  The frame table
+   lock must be held. */
+void
+frame_notify (void)
+{
+  cond_broadcast (&frame_cond, &frame_lock);
+}
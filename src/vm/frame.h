@@ -1,24 +1,36 @@
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
 
+#include <stdbool.h>
 #include <list.h>
 #include "threads/palloc.h"
 #include "threads/thread.h"
 
+struct share;
+
 /* Frame. */
 struct frame
   {
-    struct thread *thread;              /* Thread. */
+    struct thread *thread;              /* Thread, if private. */
     void *addr;                         /* Kernel virtual address. */
-    void *upage;                        /* User virtual address. */
+    void *upage;                        /* User virtual address, if private. */
+    struct share *share;                /* Shared frame, or null if private. */
+    bool pinned;                        /* Not to be evicted. */
     struct list_elem elem;              /* List element. */
   };
 
 void frame_init (void);
 void *frame_alloc (void *upage, enum palloc_flags);
+void *frame_try_alloc (void *upage, enum palloc_flags);
 void frame_free (void *page);
+void frame_share (void *page, struct share *);
+void frame_unshare (void *page, struct thread *, void *upage);
+void frame_pin (void *page);
+void frame_unpin (void *page);
 void *frame_evict (enum palloc_flags);
 void frame_acquire (void);
 void frame_release (void);
+void frame_wait (void);
+void frame_notify (void);
 
 #endif /* vm/frame.h */
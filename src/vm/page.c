@@ -6,17 +6,25 @@
 #include <hash.h>
 #include <user/syscall.h>
 #include "filesys/file.h"
+#include "filesys/filesys.h"
 #include "threads/malloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/pagedir.h"
 #include "userprog/syscall.h"
 #include "vm/frame.h"
+#include "vm/share.h"
 #include "vm/swap.h"
 
+size_t page_fault_around = 16;
+
 static hash_hash_func page_hash;
 static hash_less_func page_less;
 static hash_action_func page_destructor;
+static bool load_file (struct page *page, bool evict);
+static void begin_load (struct page *page, void *kpage);
+static void end_load (struct page *page, void *kpage);
+static bool page_copy (struct page *src);
 
 /* Initializes the supplemental page table. */
 bool
@@ -34,9 +42,13 @@ page_insert (const void *address)
   struct hash_elem *e;
 
   p->addr = (void *) address;
+  p->thread = thread_current ();
   p->loaded = true;
   p->mapid = MAP_FAILED;
   p->file = NULL;
+  p->write_back = false;
+  p->share = NULL;
+  p->state = PAGE_IDLE;
   p->valid = true;
   e = hash_insert (&thread_current ()->page_table, &p->hash_elem);
   if (e != NULL)
@@ -59,13 +71,64 @@ page_find (struct hash *page_table, const void *address)
   return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
 }
 
-/* Clears the page table. */
+/* Removes PAGE from PAGE_TABLE and frees it, along with its
+   frame or swap slot.  A modified page of a shared file mapping
+   is written back first.  The caller must hold the frame table
+   lock but not the file system lock; the frame table lock is
+   released while the page is written back or its file closed. */
+void
+page_remove (struct hash *page_table, struct page *page)
+{
+  hash_delete (page_table, &page->hash_elem);
+  page_destructor (&page->hash_elem, NULL);
+}
+
+/* Waits until no I/O is in progress on PAGE.  The caller must
+   hold the frame table lock. */
+void
+page_wait (struct page *page)
+{
+  while (page->state != PAGE_IDLE)
+    frame_wait ();
+}
+
+/* Clears the page table.  The caller must hold the frame table
+   lock but not the file system lock. */
 void
 page_destroy (struct hash *page_table)
 {
   hash_destroy (page_table, page_destructor);
 }
 
+/* Copies the pages of PARENT, which is waiting for the current
+   process to start, into the current process.  The caller must
+   hold the frame table lock.  Returns true if successful. */
+bool
+page_fork (struct thread *parent)
+{
+  struct hash_iterator i;
+  struct list_elem *e;
+  struct page *page;
+
+  /* Mapped pages first, keeping the order of mmap_list. */
+  for (e = list_begin (&parent->mmap_list); e != list_end (&parent->mmap_list);
+       e = list_next (e))
+    {
+      page = list_entry (e, struct page, elem);
+      if (!page_copy (page))
+        return false;
+    }
+
+  hash_first (&i, &parent->page_table);
+  while (hash_next (&i))
+    {
+      page = hash_entry (hash_cur (&i), struct page, hash_elem);
+      if (page->mapid == MAP_FAILED && !page_copy (page))
+        return false;
+    }
+  return true;
+}
+
 /* Load the given PAGE from swap. */
 bool
 page_load_swap (struct page *page)
@@ -76,7 +139,11 @@ page_load_swap (struct page *page)
 
   ASSERT (!page->valid);
 
-  swap_in (page, kpage);
+  if (kpage == NULL)
+    return false;
+  begin_load (page, kpage);
+  swap_in (page->swap_idx, kpage);
+  end_load (page, kpage);
   success = (pagedir_get_page (t->pagedir, page->addr) == NULL
              && pagedir_set_page (t->pagedir, page->addr, kpage, true));
   if (!success)
@@ -93,34 +160,115 @@ page_load_swap (struct page *page)
 /* Load the given PAGE from a file. */
 bool
 page_load_file (struct page *page)
+{
+  return load_file (page, true);
+}
+
+/* Loads the pages of the current process in the window of
+   page_fault_around pages around PAGE, a page just loaded from a
+   file, that are backed by the same file and not loaded yet, so
+   that a sequential scan takes one fault per window instead of
+   one per page.  Only free frames are used.  Stores in RA the
+   file bytes of the next window's pages, for the caller to pass
+   to page_read_ahead() once it has released the frame table
+   lock, which it must hold for this call. */
+void
+page_load_around (struct page *page, struct page_readahead *ra)
+{
+  struct thread *t = thread_current ();
+  struct inode *inode = file_get_inode (page->file);
+  size_t window = page_fault_around * PGSIZE;
+  uint8_t *start, *upage;
+  struct page *p;
+  off_t end = 0;
+
+  ra->file = NULL;
+  start = (uint8_t *) page->addr - (uintptr_t) page->addr % window;
+  for (upage = start; upage < start + 2 * window; upage += PGSIZE)
+    {
+      p = page_find (&t->page_table, upage);
+      if (p == NULL || p == page || p->loaded || !p->valid
+          || p->file == NULL || file_get_inode (p->file) != inode)
+        continue;
+
+      if (upage >= start + window)
+        {
+          /* Next window: read ahead only. */
+          if (ra->file == NULL)
+            {
+              ra->file = p->file;
+              ra->ofs = p->file_ofs;
+            }
+          if (ra->ofs > p->file_ofs)
+            ra->ofs = p->file_ofs;
+          if (end < p->file_ofs + (off_t) p->file_read_bytes)
+            end = p->file_ofs + p->file_read_bytes;
+        }
+      else if (load_file (p, false))
+        {
+          /* Let eviction take it first if it is never used. */
+          p->loaded = true;
+          pagedir_set_accessed (t->pagedir, upage, false);
+        }
+      else
+        break;
+    }
+  if (ra->file != NULL)
+    ra->size = end - ra->ofs;
+}
+
+/* Starts reading the bytes in RA into the buffer cache.  The
+   caller must not hold the frame table lock.  RA's file belongs
+   to pages of the current process, so it stays open. */
+void
+page_read_ahead (const struct page_readahead *ra)
+{
+  if (ra->file == NULL || ra->size <= 0)
+    return;
+  filesys_acquire ();
+  file_prefetch (ra->file, ra->size, ra->ofs);
+  filesys_release ();
+}
+
+/* Loads PAGE from its file, evicting a frame for it if none is
+   free and EVICT is true.  Returns true if successful. */
+static bool
+load_file (struct page *page, bool evict)
 {
   struct thread *t = thread_current ();
+  enum palloc_flags flags = page->file_read_bytes == 0 ? PAL_ZERO : 0;
   void *kpage;
   bool success;
 
   ASSERT (!page->loaded);
   ASSERT (page->file != NULL);
 
-  if (page->file_read_bytes == 0)
-    kpage = frame_alloc (page->addr, PAL_ZERO);
+  /* Read-only executable pages are shared between processes. */
+  if (!page->file_writable)
+    return share_load (page, evict);
+
+  if (evict)
+    kpage = frame_alloc (page->addr, flags);
   else
-    kpage = frame_alloc (page->addr, 0);
+    kpage = frame_try_alloc (page->addr, flags);
 
   if (kpage == NULL)
     return false;
 
   if (page->file_read_bytes > 0)
     {
+      begin_load (page, kpage);
       filesys_acquire ();
-      if ((int) page->file_read_bytes != file_read_at (page->file, kpage,
-                                                       page->file_read_bytes,
-                                                       page->file_ofs))
+      success = ((int) page->file_read_bytes
+                 == file_read_at (page->file, kpage, page->file_read_bytes,
+                                  page->file_ofs));
+      filesys_release ();
+      end_load (page, kpage);
+      if (!success)
         {
-          filesys_release ();
           frame_free (kpage);
           return false;
         }
-      filesys_release ();
       memset (kpage + page->file_read_bytes, 0, PGSIZE - page->file_read_bytes);
     }
 
@@ -136,6 +284,26 @@ page_load_file (struct page *page)
   return true;
 }
 
+/* Pins KPAGE, the frame PAGE is about to be read into, and
+   releases the frame table lock for the duration of the I/O. */
+static void
+begin_load (struct page *page, void *kpage)
+{
+  frame_pin (kpage);
+  page->state = PAGE_LOADING;
+  frame_release ();
+}
+
+/* Reacquires the frame table lock once PAGE has been read into
+   KPAGE, and unpins KPAGE. */
+static void
+end_load (struct page *page, void *kpage)
+{
+  frame_acquire ();
+  page->state = PAGE_IDLE;
+  frame_unpin (kpage);
+}
+
 /* Load a given PAGE with zeros. */
 bool
 page_load_zero (struct page *page)
@@ -159,6 +327,84 @@ page_load_zero (struct page *page)
   return true;
 }
 
+/* Adds a copy of SRC, a page of another process, to the current
+   process.  A page in memory is shared copy-on-write, except a
+   page of a shared file mapping, which is written back if
+   modified and read in again when touched.  A swapped out page
+   gets its own swap slot.  Disk I/O is done without the frame
+   table lock. */
+static bool
+page_copy (struct page *src)
+{
+  struct thread *t = thread_current ();
+  struct thread *src_t = src->thread;
+  struct page *dst;
+  void *kpage;
+  size_t swap_idx;
+
+  while (src->state != PAGE_IDLE || share_busy (src))
+    frame_wait ();
+  if (page_insert (src->addr) != NULL)
+    return false;
+  dst = page_find (&t->page_table, src->addr);
+  dst->loaded = src->loaded;
+  dst->file_ofs = src->file_ofs;
+  dst->file_read_bytes = src->file_read_bytes;
+  dst->file_writable = src->file_writable;
+  dst->write_back = src->write_back;
+  if (src->mapid != MAP_FAILED)
+    {
+      dst->mapid = src->mapid;
+      list_push_back (&t->mmap_list, &dst->elem);
+      if (src->file != NULL)
+        {
+          filesys_acquire ();
+          dst->file = file_reopen (src->file);
+          filesys_release ();
+          if (dst->file == NULL)
+            return false;
+        }
+    }
+  else if (src->file != NULL)
+    dst->file = t->executable;
+
+  if (!src->valid)
+    {
+      frame_release ();
+      swap_idx = swap_dup (src->swap_idx);
+      frame_acquire ();
+      if (swap_idx == SWAP_ERROR)
+        return false;
+      dst->valid = false;
+      dst->swap_idx = swap_idx;
+    }
+  else if (!src->loaded)
+    return true;
+  else if (src->write_back)
+    {
+      kpage = pagedir_get_page (src_t->pagedir, src->addr);
+      if (pagedir_is_dirty (src_t->pagedir, src->addr))
+        {
+          /* Keep the frame from being evicted meanwhile. */
+          frame_pin (kpage);
+          src->state = PAGE_EVICTING;
+          pagedir_set_dirty (src_t->pagedir, src->addr, false);
+          frame_release ();
+          filesys_acquire ();
+          file_write_at (src->file, kpage, src->file_read_bytes,
+                         src->file_ofs);
+          filesys_release ();
+          frame_acquire ();
+          src->state = PAGE_IDLE;
+          frame_unpin (kpage);
+        }
+      dst->loaded = false;
+    }
+  else
+    return share_copy (dst, src);
+  return true;
+}
+
 /* Returns a hash value for page P. */
 static unsigned
 page_hash (const struct hash_elem *p_, void *aux UNUSED)
@@ -178,7 +424,8 @@ page_less (const struct hash_elem *a_, const struct hash_elem *b_,
   return a->addr < b->addr;
 }
 
-/* Free a page. */
+/* Free a page.  Disk I/O is done without the frame table lock;
+   the page is no longer in any page table by then. */
 static void
 page_destructor (struct hash_elem *e, void *aux UNUSED)
 {
@@ -187,20 +434,39 @@ page_destructor (struct hash_elem *e, void *aux UNUSED)
   void *kpage;
 
   page = hash_entry (e, struct page, hash_elem);
+  page_wait (page);
   kpage = pagedir_get_page (t->pagedir, page->addr);
-  if (kpage != NULL)
+  if (page->share != NULL)
+    share_release (page);
+  else if (kpage != NULL)
     {
-      if (page->mapid != MAP_FAILED)
+      if (page->write_back && pagedir_is_dirty (t->pagedir, page->addr))
         {
-          if (pagedir_is_dirty (t->pagedir, page->addr))
-            file_write_at (page->file, page->addr, page->file_read_bytes,
-                           page->file_ofs);
-          list_remove (&page->elem);
+          /* Keep the frame from being evicted meanwhile. */
+          frame_pin (kpage);
+          page->state = PAGE_EVICTING;
+          frame_release ();
+          filesys_acquire ();
+          file_write_at (page->file, kpage, page->file_read_bytes,
+                         page->file_ofs);
+          filesys_release ();
+          frame_acquire ();
+          page->state = PAGE_IDLE;
+          frame_unpin (kpage);
         }
       pagedir_clear_page (t->pagedir, page->addr);
       frame_free (kpage);
     }
   if (!page->valid)
     swap_destroy (page->swap_idx);
+  if (page->mapid != MAP_FAILED)
+    {
+      list_remove (&page->elem);
+      frame_release ();
+      filesys_acquire ();
+      file_close (page->file);
+      filesys_release ();
+      frame_acquire ();
+    }
   free (page);
 }
@@ -9,29 +9,70 @@
 #include <user/syscall.h>
 #include "filesys/file.h"
 #include "filesys/off_t.h"
+#include "threads/thread.h"
+
+/* Largest the user stack may grow, in bytes. */
+#define MAX_STACK_SIZE (8 * 1024 * 1024)
+
+/* Largest value of page_fault_around. */
+#define PAGE_FAULT_AROUND_MAX 64
+
+/* Number of pages in the aligned window of file pages mapped
+   together on a fault.  1 maps only the faulting page.
+   Controlled by kernel command-line option "-fa=PAGES". */
+extern size_t page_fault_around;
+
+struct share;
+
+/* I/O in progress on a page. */
+enum page_state
+  {
+    PAGE_IDLE,                          /* None. */
+    PAGE_LOADING,                       /* Being read into a frame. */
+    PAGE_EVICTING                       /* Being written out of its frame. */
+  };
 
 /* Page. */
 struct page
   {
     void *addr;                         /* Virtual address. */
+    struct thread *thread;              /* Owning thread. */
     bool loaded;                        /* Page is loaded. */
     mapid_t mapid;                      /* Mapping identifier. */
     struct file *file;                  /* Loaded file. */
     off_t file_ofs;                     /* Offset of the file. */
     uint32_t file_read_bytes;           /* Number of read bytes from file. */
     bool file_writable;                 /* File is writable. */
+    bool write_back;                    /* Write changes back to FILE. */
+    struct share *share;                /* Shared frame, if mapped to one. */
+    struct list_elem share_elem;        /* Element in the share's pages. */
+    enum page_state state;              /* I/O in progress. */
     bool valid;                         /* Frame is not swapped out. */
     size_t swap_idx;                    /* Swap index of the frame. */
     struct hash_elem hash_elem;         /* Hash table element. */
     struct list_elem elem;              /* List element. */
   };
 
+/* File bytes to read ahead after a fault, found by
+   page_load_around() and read by page_read_ahead(). */
+struct page_readahead
+  {
+    struct file *file;                  /* File, or null if none. */
+    off_t ofs;                          /* Offset of the first byte. */
+    off_t size;                         /* Number of bytes. */
+  };
+
 bool page_init (struct hash *page_table);
 struct page *page_insert (const void *address);
 struct page *page_find (struct hash *page_table, const void *address);
+void page_remove (struct hash *page_table, struct page *page);
 void page_destroy (struct hash *page_table);
+void page_wait (struct page *page);
+bool page_fork (struct thread *parent);
 bool page_load_swap (struct page *page);
 bool page_load_file (struct page *page);
+void page_load_around (struct page *page, struct page_readahead *);
+void page_read_ahead (const struct page_readahead *);
 bool page_load_zero (struct page *page);
 
 #endif /* vm/page.h */
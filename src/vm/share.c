@@ -0,0 +1,542 @@
+#include "vm/share.h"
+#include <debug.h>
+#include <string.h>
+#include <hash.h>
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Frames mapped read-only by more than one page: read-only
+   pages of executables, shared by every process that maps the
+   same page of the same file and found through a table, and the
+   pages of forked processes, shared copy-on-write until one of
+   them writes.
+
+   A shared frame is in the frame table, and each share keeps a
+   list of the pages mapping it, so that the frame can be
+   unmapped everywhere at once.  A frame shared from a file is
+   clean, so frame_evict() may drop it and let each page read it
+   in again.  A copy-on-write frame has no other copy, so it is
+   evicted to a swap slot that the share keeps, and the first
+   page to touch it again reads it back in for all of them.  As
+   soon as only one page maps a copy-on-write frame, it becomes
+   that page's private, writable frame, or swap slot, again.
+
+   Shared frames are protected by the frame table lock. */
+
+/* Shared frame. */
+struct share
+  {
+    struct inode *inode;                /* File's inode, or null if
+                                           copy-on-write. */
+    off_t ofs;                          /* Offset in the file. */
+    struct file *file;                  /* Keeps INODE open. */
+    void *kpage;                        /* Kernel virtual address, or
+                                           null if swapped out. */
+    size_t swap_idx;                    /* Swap slot, if swapped out. */
+    int map_cnt;                        /* Number of pages mapping it. */
+    struct list pages;                  /* Pages mapping it. */
+    bool loading;                       /* Being read in or written out. */
+    struct hash_elem hash_elem;         /* Hash table element. */
+  };
+
+/* Shared frames, by inode and offset. */
+static struct hash share_table;
+
+static hash_hash_func share_hash;
+static hash_less_func share_less;
+static void share_add (struct share *, struct page *);
+static void share_drop (struct share *, struct page *);
+static void share_settle (struct share *);
+static void share_free (struct share *);
+
+/* Initializes the shared frame table. */
+void
+share_init (void)
+{
+  hash_init (&share_table, share_hash, share_less, NULL);
+}
+
+/* Maps PAGE, a read-only page of an executable, to the shared
+   frame holding its contents, reading them in first if no
+   process has them yet.  A frame is evicted for it only if EVICT
+   is true.  Returns true if successful. */
+bool
+share_load (struct page *page, bool evict)
+{
+  struct thread *t = thread_current ();
+  struct hash_elem *e;
+  struct share key, *s;
+  void *kpage = NULL;
+  bool success;
+
+  ASSERT (page->file != NULL && !page->file_writable);
+  ASSERT (page->share == NULL);
+
+  /* Look for the frame, waiting out another process's read of
+     it.  Evicting a frame may release the frame table lock, so
+     look again once one is obtained.  The new frame stays pinned
+     until it is read in. */
+  key.inode = file_get_inode (page->file);
+  key.ofs = page->file_ofs;
+  for (;;)
+    {
+      e = hash_find (&share_table, &key.hash_elem);
+      if (e != NULL)
+        {
+          s = hash_entry (e, struct share, hash_elem);
+          if (!s->loading)
+            break;
+          frame_wait ();
+        }
+      else if (kpage == NULL)
+        {
+          if (evict)
+            kpage = frame_alloc (page->addr, 0);
+          else
+            kpage = frame_try_alloc (page->addr, 0);
+          if (kpage == NULL)
+            return false;
+          frame_pin (kpage);
+        }
+      else
+        break;
+    }
+
+  if (e != NULL)
+    {
+      if (kpage != NULL)
+        {
+          frame_unpin (kpage);
+          frame_free (kpage);
+        }
+    }
+  else
+    {
+      s = malloc (sizeof *s);
+      if (s == NULL)
+        {
+          frame_unpin (kpage);
+          frame_free (kpage);
+          return false;
+        }
+      s->inode = key.inode;
+      s->ofs = key.ofs;
+      s->file = NULL;
+      s->kpage = kpage;
+      s->map_cnt = 0;
+      list_init (&s->pages);
+      s->loading = true;
+      hash_insert (&share_table, &s->hash_elem);
+      frame_share (kpage, s);
+
+      /* Read it in without the frame table lock.  Other processes
+         faulting on the same page wait for it. */
+      frame_release ();
+      filesys_acquire ();
+      s->file = file_reopen (page->file);
+      success = (s->file != NULL
+                 && (file_read_at (s->file, kpage, page->file_read_bytes,
+                                   page->file_ofs)
+                     == (int) page->file_read_bytes));
+      filesys_release ();
+      frame_acquire ();
+      s->loading = false;
+      frame_unpin (kpage);
+      if (!success)
+        {
+          share_free (s);
+          return false;
+        }
+      memset ((uint8_t *) kpage + page->file_read_bytes, 0,
+              PGSIZE - page->file_read_bytes);
+    }
+
+  if (pagedir_get_page (t->pagedir, page->addr) != NULL
+      || !pagedir_set_page (t->pagedir, page->addr, s->kpage, false))
+    {
+      if (s->map_cnt == 0)
+        share_free (s);
+      return false;
+    }
+  pagedir_set_accessed (t->pagedir, page->addr, true);
+  share_add (s, page);
+  return true;
+}
+
+/* Maps DST, a page of the current process, to the frame of SRC,
+   a page of another process that must be in memory or mapped to
+   a swapped out copy-on-write frame, with no I/O in progress on
+   it (see share_busy()).  If SRC's
+   frame is not shared yet, it becomes a copy-on-write frame and
+   SRC's mapping becomes read-only.  Returns true if
+   successful. */
+bool
+share_copy (struct page *dst, struct page *src)
+{
+  struct thread *t = thread_current ();
+  struct thread *src_t = src->thread;
+  struct share *s = src->share;
+  void *kpage;
+
+  if (s == NULL)
+    {
+      kpage = pagedir_get_page (src_t->pagedir, src->addr);
+      ASSERT (kpage != NULL);
+
+      s = malloc (sizeof *s);
+      if (s == NULL)
+        return false;
+      s->inode = NULL;
+      s->ofs = 0;
+      s->file = NULL;
+      s->kpage = kpage;
+      s->map_cnt = 0;
+      list_init (&s->pages);
+      s->loading = false;
+      frame_share (kpage, s);
+      pagedir_clear_page (src_t->pagedir, src->addr);
+      pagedir_set_page (src_t->pagedir, src->addr, kpage, false);
+      share_add (s, src);
+    }
+
+  /* A swapped out frame is mapped when DST is touched. */
+  if (s->kpage != NULL
+      && !pagedir_set_page (t->pagedir, dst->addr, s->kpage, false))
+    {
+      share_settle (s);
+      return false;
+    }
+  share_add (s, dst);
+  return true;
+}
+
+/* Handles a write to PAGE of the current process.  If PAGE is
+   mapped to a copy-on-write frame, gives it a private, writable
+   copy of the frame and returns true.  Also returns true if PAGE
+   has become private since the write faulted, so that the write
+   is simply retried.  Otherwise, or if memory is not available,
+   returns false. */
+bool
+share_write (struct page *page)
+{
+  struct thread *t = thread_current ();
+  struct share *s = page->share;
+  void *kpage;
+
+  /* Private frames are always mapped writable.  A shared frame
+     evicted since the fault is read back in by the next one. */
+  if (s == NULL)
+    return pagedir_get_page (t->pagedir, page->addr) != NULL;
+  if (s->inode != NULL)
+    return false;
+  if (s->kpage == NULL)
+    return true;
+
+  /* Allocating may release the frame table lock, letting the
+     other pages mapping S go and leaving PAGE with its frame, or
+     letting S be evicted. */
+  kpage = frame_alloc (page->addr, 0);
+  if (page->share != s || s->kpage == NULL)
+    {
+      if (kpage != NULL)
+        frame_free (kpage);
+      return true;
+    }
+  if (kpage == NULL)
+    return false;
+  memcpy (kpage, s->kpage, PGSIZE);
+  share_drop (s, page);
+
+  /* The contents may differ from any file the page came from, so
+     it must go to swap if evicted. */
+  pagedir_clear_page (t->pagedir, page->addr);
+  pagedir_set_page (t->pagedir, page->addr, kpage, true);
+  pagedir_set_dirty (t->pagedir, page->addr, true);
+  pagedir_set_accessed (t->pagedir, page->addr, true);
+  return true;
+}
+
+/* Unmaps PAGE from its shared frame, freeing the frame if no
+   other page maps it.  May release the frame table lock for a
+   while if it frees the frame. */
+void
+share_release (struct page *page)
+{
+  struct share *s = page->share;
+
+  ASSERT (s != NULL);
+
+  pagedir_clear_page (page->thread->pagedir, page->addr);
+  share_drop (s, page);
+}
+
+/* Returns whether frame_evict() may evict the frame of S. */
+bool
+share_evictable (const struct share *s)
+{
+  return !s->loading;
+}
+
+/* Returns whether I/O is in progress on the shared frame of
+   PAGE, if it has one. */
+bool
+share_busy (const struct page *page)
+{
+  return page->share != NULL && page->share->loading;
+}
+
+/* Returns whether any page mapping S was accessed since the last
+   call, and clears their accessed bits. */
+bool
+share_accessed (struct share *s)
+{
+  struct list_elem *e;
+  struct page *p;
+  bool accessed = false;
+
+  for (e = list_begin (&s->pages); e != list_end (&s->pages);
+       e = list_next (e))
+    {
+      p = list_entry (e, struct page, share_elem);
+      if (pagedir_is_accessed (p->thread->pagedir, p->addr))
+        {
+          accessed = true;
+          pagedir_set_accessed (p->thread->pagedir, p->addr, false);
+        }
+    }
+  return accessed;
+}
+
+/* Evicts the frame of S, which must be evictable, unmapping it
+   from every page mapping it.  A frame shared from a file is
+   dropped, and S freed, so that each page reads it in again when
+   touched.  A copy-on-write frame is written to swap first.  The
+   frame stays in the frame table for the caller to reuse.
+   Releases the frame table lock for the I/O. */
+void
+share_evict (struct share *s)
+{
+  struct list_elem *e;
+  struct page *p;
+  struct file *file;
+  void *kpage = s->kpage;
+
+  ASSERT (share_evictable (s));
+
+  for (e = list_begin (&s->pages); e != list_end (&s->pages);
+       e = list_next (e))
+    {
+      p = list_entry (e, struct page, share_elem);
+      pagedir_clear_page (p->thread->pagedir, p->addr);
+    }
+
+  if (s->inode != NULL)
+    {
+      while (!list_empty (&s->pages))
+        {
+          p = list_entry (list_pop_front (&s->pages),
+                          struct page, share_elem);
+          p->share = NULL;
+          p->loaded = false;
+        }
+      hash_delete (&share_table, &s->hash_elem);
+      file = s->file;
+      free (s);
+
+      frame_release ();
+      filesys_acquire ();
+      file_close (file);
+      filesys_release ();
+      frame_acquire ();
+    }
+  else
+    {
+      /* Faults on the pages wait until it is written out. */
+      s->kpage = NULL;
+      s->loading = true;
+      frame_release ();
+      s->swap_idx = swap_out (kpage);
+      frame_acquire ();
+      s->loading = false;
+
+      /* Pages may have stopped mapping S meanwhile. */
+      share_settle (s);
+    }
+}
+
+/* Maps PAGE of the current process, after a fault on it, to its
+   copy-on-write frame, reading the frame back in from swap first
+   if it was evicted.  Returns true if successful, including if
+   PAGE stopped being shared meanwhile, so that the access is
+   simply retried. */
+bool
+share_fault (struct page *page)
+{
+  struct thread *t = thread_current ();
+  struct share *s = page->share;
+  void *kpage;
+
+  ASSERT (s != NULL);
+
+  while (s->loading)
+    {
+      frame_wait ();
+      if (page->share != s)
+        return true;
+    }
+
+  if (s->kpage == NULL)
+    {
+      /* Allocating may release the frame table lock, so check
+         again afterward. */
+      kpage = frame_alloc (page->addr, 0);
+      if (page->share != s || s->loading || s->kpage != NULL)
+        {
+          if (kpage != NULL)
+            frame_free (kpage);
+          return page->share != s || share_fault (page);
+        }
+      if (kpage == NULL)
+        return false;
+
+      frame_pin (kpage);
+      frame_share (kpage, s);
+      s->loading = true;
+      frame_release ();
+      swap_in (s->swap_idx, kpage);
+      frame_acquire ();
+      s->kpage = kpage;
+      s->loading = false;
+      frame_unpin (kpage);
+
+      /* Pages may have stopped mapping S meanwhile, leaving PAGE
+         with its frame. */
+      share_settle (s);
+      if (page->share != s)
+        return true;
+    }
+
+  if (!pagedir_set_page (t->pagedir, page->addr, s->kpage, false))
+    return false;
+  pagedir_set_accessed (t->pagedir, page->addr, true);
+  return true;
+}
+
+/* Adds PAGE to the pages mapping S. */
+static void
+share_add (struct share *s, struct page *page)
+{
+  list_push_back (&s->pages, &page->share_elem);
+  s->map_cnt++;
+  page->share = s;
+}
+
+/* Removes PAGE from the pages mapping S, freeing S if no page
+   maps it any more.  May release the frame table lock for a
+   while if it frees S. */
+static void
+share_drop (struct share *s, struct page *page)
+{
+  list_remove (&page->share_elem);
+  page->share = NULL;
+  s->map_cnt--;
+  share_settle (s);
+}
+
+/* Frees S if no page maps it any more.  If S is a copy-on-write
+   frame mapped by a single page, makes it that page's private,
+   writable frame, or swap slot, again and frees S.  Does nothing
+   while I/O is in progress on S; whoever does the I/O calls this
+   afterward.  May release the frame table lock for a while if it
+   frees S. */
+static void
+share_settle (struct share *s)
+{
+  struct page *p;
+  struct thread *t;
+
+  if (s->loading)
+    return;
+  if (s->map_cnt == 0)
+    {
+      share_free (s);
+      return;
+    }
+  if (s->inode != NULL || s->map_cnt != 1)
+    return;
+
+  p = list_entry (list_front (&s->pages), struct page, share_elem);
+  p->share = NULL;
+  if (s->kpage == NULL)
+    {
+      p->valid = false;
+      p->swap_idx = s->swap_idx;
+      free (s);
+      return;
+    }
+  t = p->thread;
+  frame_unshare (s->kpage, t, p->addr);
+
+  /* Cannot fail: the page table is already there.  The contents
+     may differ from the file the page came from, so it must go
+     to swap if evicted. */
+  pagedir_clear_page (t->pagedir, p->addr);
+  if (!pagedir_set_page (t->pagedir, p->addr, s->kpage, true))
+    NOT_REACHED ();
+  pagedir_set_dirty (t->pagedir, p->addr, true);
+  free (s);
+}
+
+/* Removes S from the table, if it is there, and frees it and its
+   frame or swap slot.  Closes S's file without the frame table lock, so the
+   lock is released for a while if S has one. */
+static void
+share_free (struct share *s)
+{
+  struct file *file = s->file;
+
+  if (s->inode != NULL)
+    hash_delete (&share_table, &s->hash_elem);
+  if (s->kpage != NULL)
+    frame_free (s->kpage);
+  else
+    swap_destroy (s->swap_idx);
+  free (s);
+
+  if (file != NULL)
+    {
+      frame_release ();
+      filesys_acquire ();
+      file_close (file);
+      filesys_release ();
+      frame_acquire ();
+    }
+}
+
+/* Returns a hash value for shared frame S. */
+static unsigned
+share_hash (const struct hash_elem *s_, void *aux UNUSED)
+{
+  const struct share *s = hash_entry (s_, struct share, hash_elem);
+  return hash_bytes (&s->inode, sizeof s->inode) ^ hash_int (s->ofs);
+}
+
+/* Returns true if shared frame A precedes shared frame B. */
+static bool
+share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct share *a = hash_entry (a_, struct share, hash_elem);
+  const struct share *b = hash_entry (b_, struct share, hash_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  return a->ofs < b->ofs;
+}
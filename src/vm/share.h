@@ -0,0 +1,22 @@
+#ifndef VM_SHARE_H
+#define VM_SHARE_H
+
+#include <stdbool.h>
+#include "filesys/file.h"
+#include "threads/thread.h"
+#include "vm/page.h"
+
+struct share;
+
+void share_init (void);
+bool share_load (struct page *page, bool evict);
+bool share_copy (struct page *dst, struct page *src);
+bool share_write (struct page *page);
+void share_release (struct page *page);
+bool share_evictable (const struct share *);
+bool share_busy (const struct page *);
+bool share_accessed (struct share *);
+void share_evict (struct share *);
+bool share_fault (struct page *page);
+
+#endif /* vm/share.h */
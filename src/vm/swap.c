@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <bitmap.h>
 #include "devices/disk.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
@@ -44,20 +45,21 @@ swap_out (void *kpage)
   return swap_idx;
 }
 
-/* Swap the frame KPAGE in for the given PAGE. */
+/* Reads swap slot SWAP_IDX into the frame KPAGE and frees the
+   slot. */
 void
-swap_in (struct page *page, void *kpage)
+swap_in (size_t swap_idx, void *kpage)
 {
   struct disk *d = disk_get (1, 1);
   disk_sector_t sec_no;
 
-  ASSERT (bitmap_test (swap_table, page->swap_idx));
+  ASSERT (bitmap_test (swap_table, swap_idx));
 
   lock_acquire (&swap_lock);
   for (sec_no = 0; sec_no < PGSIZE / DISK_SECTOR_SIZE; sec_no++)
-    disk_read (d, page->swap_idx * PGSIZE / DISK_SECTOR_SIZE + sec_no,
+    disk_read (d, swap_idx * PGSIZE / DISK_SECTOR_SIZE + sec_no,
                kpage + sec_no * DISK_SECTOR_SIZE);
-  bitmap_set (swap_table, page->swap_idx, false);
+  bitmap_set (swap_table, swap_idx, false);
   lock_release (&swap_lock);
 }
 
@@ -71,3 +73,40 @@ swap_destroy (size_t swap_idx)
   bitmap_set (swap_table, swap_idx, false);
   lock_release (&swap_lock);
 }
+
+/* Copies swap slot SWAP_IDX to a new slot and returns the new
+   slot's index, or SWAP_ERROR if memory or swap slots are not
+   available. */
+size_t
+swap_dup (size_t swap_idx)
+{
+  struct disk *d = disk_get (1, 1);
+  size_t new_idx;
+  disk_sector_t sec_no;
+  uint8_t *buf;
+
+  ASSERT (bitmap_test (swap_table, swap_idx));
+
+  buf = palloc_get_page (0);
+  if (buf == NULL)
+    return SWAP_ERROR;
+
+  lock_acquire (&swap_lock);
+  new_idx = bitmap_scan_and_flip (swap_table, 0, 1, false);
+  if (new_idx == BITMAP_ERROR)
+    {
+      lock_release (&swap_lock);
+      palloc_free_page (buf);
+      return SWAP_ERROR;
+    }
+  for (sec_no = 0; sec_no < PGSIZE / DISK_SECTOR_SIZE; sec_no++)
+    disk_read (d, swap_idx * PGSIZE / DISK_SECTOR_SIZE + sec_no,
+               buf + sec_no * DISK_SECTOR_SIZE);
+  for (sec_no = 0; sec_no < PGSIZE / DISK_SECTOR_SIZE; sec_no++)
+    disk_write (d, new_idx * PGSIZE / DISK_SECTOR_SIZE + sec_no,
+                buf + sec_no * DISK_SECTOR_SIZE);
+  lock_release (&swap_lock);
+
+  palloc_free_page (buf);
+  return new_idx;
+}
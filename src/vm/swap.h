@@ -2,11 +2,16 @@
 #define VM_SWAP_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include "vm/page.h"
 
+/* Returned by swap_dup() on failure. */
+#define SWAP_ERROR SIZE_MAX
+
 void swap_init (void);
 size_t swap_out (void *kpage);
-void swap_in (struct page *page, void *kpage);
+void swap_in (size_t swap_idx, void *kpage);
 void swap_destroy (size_t swap_idx);
+size_t swap_dup (size_t swap_idx);
 
 #endif /* vm/swap.h */